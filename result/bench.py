@@ -6,7 +6,9 @@ Key = collections.namedtuple('Key', 'count length plen slen')
 
 data = collections.defaultdict(lambda: [[], []])
 for line in sys.stdin:
-        name, count, length, plen, slen, time = line.split(',')
+        if line.startswith('name,'):
+                continue
+        name, count, length, plen, slen, time = line.split(',')[:6]
         length = int(length)
         if length < 10:
                 continue
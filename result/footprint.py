@@ -0,0 +1,83 @@
+import math
+import sys
+import collections
+
+# Reads bench CSV (name,count,length,plen,slen,time,bytes,build_ns) on
+# standard input and plots bytes per word and build time per word
+# against number of words for words of given length (10 by default).
+
+LENGTH = int(sys.argv[1]) if len(sys.argv) > 1 else 10
+
+memory = collections.defaultdict(dict)
+build = collections.defaultdict(dict)
+for line in sys.stdin:
+        fields = line.strip().split(',')
+        if len(fields) < 8 or fields[0] == 'name':
+                continue
+        name, count, length = fields[0], int(fields[1]), int(fields[2])
+        if length != LENGTH or not count:
+                continue
+        memory[name][count] = int(fields[6]) / count
+        ns = int(fields[7]) / count
+        build[name][count] = min(build[name].get(count, ns), ns)
+
+COLOURS = ('#e41a1c', '#377eb8', '#4daf4a', '#984ea3',
+           '#ff7f00', '#a65628', '#f781bf', '#999999')
+
+
+def wr(msg, *args, **kw):
+        if args or kw:
+                msg = msg.format(*args, **kw)
+        sys.stdout.write(msg)
+
+def fmt_log_num(n):
+        if n < 3:
+                return str(10 ** n)
+        elif n < 6:
+                return str(10 ** (n - 3)) + ' k'
+        else:
+                return str(10 ** (n - 6)) + ' M'
+
+def cx(panel, x):
+        return panel * 280 + 60 + x * 35
+def cy(y):
+        return 360 - y * 40
+
+
+wr("""<?xml version="1.0" encoding="UTF-8"?>
+<svg xmlns="http://www.w3.org/2000/svg" version="1.1"
+     width="35em" height="26.25em" viewBox="0 0 560 420"
+     stroke-width="1" text-anchor="middle" fill="none">
+""")
+
+for panel, (title, data) in enumerate((('Bytes per word', memory),
+                                       ('Build ns per word', build))):
+        wr('  <path stroke="#ccebc5" d="')
+        for y in range(9):
+                wr('M{},{}H{}', cx(panel, 0), cy(y), cx(panel, 6))
+        wr('" />\n')
+        for i, (name, points) in enumerate(sorted(data.items())):
+                wr('  <path stroke="{}" d="M', COLOURS[i % len(COLOURS)])
+                wr('L'.join('{},{}'.format(
+                        cx(panel, math.log10(count)),
+                        cy(math.log10(max(value, 1))))
+                             for count, value in sorted(points.items())))
+                wr('" />\n')
+        wr('  <g font-size="14" fill="#000">\n')
+        wr('    <text x="{}" y="20">{}</text>\n',
+           (cx(panel, 0) + cx(panel, 6)) // 2, title)
+        wr('    <text text-anchor="end">')
+        for y in range(0, 9, 2):
+                wr('<tspan x="{}" y="{}">{}</tspan>',
+                   cx(panel, 0) - 4, cy(y) + 4, fmt_log_num(y))
+        wr('</text>\n    <text y="{}">', cy(0) + 18)
+        for x in range(0, 7, 2):
+                wr('<tspan x="{}">{}</tspan>', cx(panel, x), fmt_log_num(x))
+        wr('</text>\n  </g>\n')
+
+wr('  <g font-size="12">\n')
+for i, name in enumerate(sorted(set(memory) | set(build))):
+        wr('    <text x="{}" y="{}" fill="{}">{}</text>\n',
+           60 + (i % 4) * 130, 400 + (i // 4) * 14,
+           COLOURS[i % len(COLOURS)], name.replace('<', '&lt;'))
+wr('  </g>\n</svg>\n')
@@ -0,0 +1,83 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_ANY_MATCHER_H
+#define H_ANY_MATCHER_H
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "engines.h"
+#include "result-sink.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Type-erased matcher for programs which pick the engine at run time.
+   query() appends up to limit matching ids to out and returns how many
+   it appended. */
+struct AnyMatcher {
+	virtual ~AnyMatcher() {}
+
+	virtual size_t size() const = 0;
+	virtual size_t word_length() const = 0;
+	virtual size_t memory_usage() const = 0;
+	virtual size_t query(std::string_view prefix,
+	                     std::string_view suffix,
+	                     std::vector<uint32_t> &out,
+	                     size_t limit) const = 0;
+
+	static std::unique_ptr<AnyMatcher> make(std::string_view engine,
+	                                        const Words &words) COLD;
+};
+
+
+template <class Matcher>
+struct AnyMatcherImpl final : AnyMatcher {
+	AnyMatcherImpl(const Words &words) : matcher(words) {}
+
+	size_t size() const override { return matcher.size(); }
+	size_t word_length() const override { return matcher.word_length(); }
+	size_t memory_usage() const override {
+		return sizeof *this - sizeof matcher + matcher.memory_usage();
+	}
+
+	size_t query(std::string_view prefix, std::string_view suffix,
+	             std::vector<uint32_t> &out,
+	             size_t limit) const override HOT {
+		VectorSink sink(out);
+		return matcher.query(prefix, suffix, sink, limit);
+	}
+
+private:
+	const Matcher matcher;
+};
+
+
+inline std::unique_ptr<AnyMatcher> AnyMatcher::make(std::string_view engine,
+                                                    const Words &words) {
+#define ENGINE(id, name, type) \
+	if (engine == id) { \
+		return std::make_unique<AnyMatcherImpl<type>>(words); \
+	}
+	FOR_EACH_ENGINE(ENGINE)
+#undef ENGINE
+	return nullptr;
+}
+
+
+#endif
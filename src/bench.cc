@@ -15,23 +15,27 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include <algorithm>
+#include <atomic>
+#include <barrier>
 #include <cinttypes>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
 #include <utility>
 #include <random>
+#include <thread>
+#include <vector>
 
-#include "bitmap-matcher.h"
-#include "trie-matcher.h"
-#include "trie-mix-matcher.h"
-#include "vector-matcher.h"
-#include "vector-range-matcher.h"
+#include <pthread.h>
+#include <sched.h>
 
-
-#ifndef MATCHER
-#  error "Expected MATCHER to be defined"
-#endif
+#include "engines.h"
+#include "numa.h"
 
 
 using Query = std::pair<std::string_view, std::string_view>;
@@ -68,28 +72,303 @@ static void generate_rand_data() {
 }
 
 
+/* Makes given fraction of count words of given length start with the
+   first half of the first word.  In such dictionary a long prefix is
+   often shared by most words while a short suffix is rare, which is
+   where choosing trie by prefix and suffix length goes wrong. */
+static void skew_rand_data(size_t count, size_t length, double skew) COLD;
+static void skew_rand_data(size_t count, size_t length, double skew) {
+	for (size_t i = 1; i < count; ++i) {
+		if (static_cast<size_t>((i + 1) * skew) !=
+		    static_cast<size_t>(i * skew)) {
+			std::copy(buffer, buffer + length / 2,
+			          buffer + i * length);
+		}
+	}
+}
+
+
 static constexpr int64_t nsec(timespec spec) {
 	const int64_t sec = spec.tv_sec, nsec = spec.tv_nsec;
 	return sec * INT64_C(1'000'000'000) + nsec;
 }
 
 
-template <class Matcher>
-static size_t run_bench(const Matcher &matcher,
-                        size_t plen, size_t slen, size_t reps) {
+/* Identifies a single measurement: engine name, count, length, prefix
+   length and suffix length. */
+using Key = std::tuple<std::string, size_t, size_t, size_t, size_t>;
+
+struct Result {
+	const char *name;
+	size_t count, length, plen, slen;
+	double us, stddev_us;
+	size_t bytes;
+	int64_t build_ns;
+	size_t sum, reps;
+	unsigned threads;
+	double qps, max_us;
+	bool cached;
+	double hit_rate;
+	/* Work counters summed over that many queries; queries is zero if
+	   work wasn't counted. */
+	QueryStats work;
+	size_t queries;
+	/* Latency of single queries; zero if not measured.  reloads is
+	   number of indices published while measuring. */
+	double p50_us, p99_us;
+	size_t reloads;
+};
+
+enum class Format { text, csv, json };
+
+struct Options {
+	std::vector<const char *> engines;
+	std::vector<size_t> counts, lengths, plens, slens;
+	Format format = Format::text;
+	unsigned repeat = 1;
+	double threshold = 0.05;
+	std::map<Key, double> baseline;
+	std::vector<size_t> threads;
+	std::vector<int> cpus;
+	std::vector<size_t> shards;
+	bool numa = false;
+	bool stats = false;
+	bool latency = false;
+	bool reload = false;
+	size_t limit = SIZE_MAX;
+	double zipf = 0;
+	size_t cache = 0;
+	double miss = 0;
+	double skew = 0;
+	size_t filter = 0;
+	size_t parallel = 0;
+	std::vector<size_t> mismatches;
+};
+
+
+static bool wanted(const std::vector<size_t> &filter, size_t value) {
+	return filter.empty() ||
+		std::find(filter.begin(), filter.end(), value) != filter.end();
+}
+
+
+static void print_head(const Options &opts, const Result &res) {
+	if (opts.format == Format::text) {
+		printf("%-14s %8zu×%-8zu %8zu…%-8zu",
+		       res.name, res.count, res.length, res.plen, res.slen);
+		fflush(stdout);
+	}
+}
+
+static bool print_tail(const Options &opts, const Result &res) {
+	/* Regression is reported if the result is slower than baseline by
+	   more than configured threshold or three standard deviations of
+	   the repeated runs, whichever is larger. */
+	const auto it = res.threads ? opts.baseline.end() : opts.baseline.find(
+		Key(res.name, res.count, res.length, res.plen, res.slen));
+	const double base = it == opts.baseline.end() ? 0 : it->second;
+	const double noise = std::max(opts.threshold,
+	                              3 * res.stddev_us / res.us);
+	const bool regression = base && res.us > base * (1 + noise);
+	static bool first = true;
+
+	switch (opts.format) {
+	case Format::text:
+		printf(" %12.3f µs %12zu B %14" PRId64 " ns (%zu %zu)",
+		       res.us, res.bytes, res.build_ns, res.sum, res.reps);
+		if (res.threads) {
+			printf(" %3u× %14.0f q/s max %.3f µs",
+			       res.threads, res.qps, res.max_us);
+		}
+		if (res.cached) {
+			printf(" hit %5.1f%%", res.hit_rate * 100);
+		}
+		if (res.p99_us) {
+			printf(" p50 %.3f µs p99 %.3f µs",
+			       res.p50_us, res.p99_us);
+		}
+		if (res.reloads) {
+			printf(" %zu reloads", res.reloads);
+		}
+		if (res.queries) {
+			const double q = res.queries;
+			printf(" [%.1f followed %.1f fanned %.1f compared "
+			       "%.1f filtered %.1f results]",
+			       res.work.followed / q, res.work.fanned / q,
+			       res.work.compared / q, res.work.filtered / q,
+			       res.work.results / q);
+		}
+		if (base) {
+			printf(" %+7.1f%%%s", (res.us / base - 1) * 100,
+			       regression ? " REGRESSION" : "");
+		}
+		putchar('\n');
+		break;
+	case Format::csv:
+		/* Every row has every column; those which don't apply to
+		   a result are left empty.  The first six columns are what
+		   --baseline reads. */
+		if (first) {
+			puts("name,count,length,plen,slen,time_us,bytes,build_ns,"
+			     "threads,qps,max_us,hit_rate,p50_us,p99_us,reloads,"
+			     "followed,fanned,compared,filtered,results");
+		}
+		printf("%s,%zu,%zu,%zu,%zu,%.3f,%zu,%" PRId64,
+		       res.name, res.count, res.length, res.plen, res.slen,
+		       res.us, res.bytes, res.build_ns);
+		if (res.threads) {
+			printf(",%u,%.0f,%.3f", res.threads, res.qps, res.max_us);
+		} else {
+			fputs(",,,", stdout);
+		}
+		if (res.cached) {
+			printf(",%.4f", res.hit_rate);
+		} else {
+			putchar(',');
+		}
+		if (res.p99_us) {
+			printf(",%.3f,%.3f", res.p50_us, res.p99_us);
+		} else {
+			fputs(",,", stdout);
+		}
+		if (res.reloads) {
+			printf(",%zu", res.reloads);
+		} else {
+			putchar(',');
+		}
+		if (res.queries) {
+			const double q = res.queries;
+			printf(",%.1f,%.1f,%.1f,%.1f,%.1f",
+			       res.work.followed / q, res.work.fanned / q,
+			       res.work.compared / q, res.work.filtered / q,
+			       res.work.results / q);
+		} else {
+			fputs(",,,,,", stdout);
+		}
+		putchar('\n');
+		first = false;
+		break;
+	case Format::json:
+		printf("%s{\"engine\": \"%s\", \"count\": %zu, "
+		       "\"length\": %zu, \"plen\": %zu, \"slen\": %zu, "
+		       "\"time_us\": %.3f, \"stddev_us\": %.3f, "
+		       "\"bytes\": %zu, \"build_ns\": %" PRId64,
+		       first ? "" : ",\n ",
+		       res.name, res.count, res.length, res.plen, res.slen,
+		       res.us, res.stddev_us, res.bytes, res.build_ns);
+		if (res.threads) {
+			printf(", \"threads\": %u, \"qps\": %.0f, "
+			       "\"max_us\": %.3f",
+			       res.threads, res.qps, res.max_us);
+		}
+		if (res.cached) {
+			printf(", \"hit_rate\": %.4f", res.hit_rate);
+		}
+		if (res.p99_us) {
+			printf(", \"p50_us\": %.3f, \"p99_us\": %.3f, "
+			       "\"reloads\": %zu",
+			       res.p50_us, res.p99_us, res.reloads);
+		}
+		if (res.queries) {
+			const double q = res.queries;
+			printf(", \"followed\": %.1f, \"fanned\": %.1f, "
+			       "\"compared\": %.1f, \"filtered\": %.1f, "
+			       "\"results\": %.1f",
+			       res.work.followed / q, res.work.fanned / q,
+			       res.work.compared / q, res.work.filtered / q,
+			       res.work.results / q);
+		}
+		if (base) {
+			printf(", \"baseline_us\": %.3f, \"regression\": %s",
+			       base, regression ? "true" : "false");
+		}
+		putchar('}');
+		first = false;
+		break;
+	}
+	fflush(stdout);
+
+	if (regression && opts.format != Format::text) {
+		fprintf(stderr, "%s %zu×%zu %zu…%zu: "
+		        "%.3f µs → %.3f µs (%+.1f%%) REGRESSION\n",
+		        res.name, res.count, res.length, res.plen, res.slen,
+		        base, res.us, (res.us / base - 1) * 100);
+	}
+	return !regression;
+}
+
+
+/* Returns queries to run for given word, prefix and suffix lengths.  By
+   default that's 20 queries spread over the buffer.  With --zipf it's
+   a long sequence drawn from a Zipf distribution over a set of distinct
+   queries, which is what a query cache sees in practice.
+
+   With --miss given fraction of the queries is made unlikely to match by
+   taking the suffix from the following word, or with no suffix shifting
+   the prefix by one character.  Prefix still matches a word so engines
+   walk deep before failing. */
+static std::vector<Query> make_queries(const Options &opts, size_t len,
+                                       size_t plen, size_t slen) {
 	static_assert(max_word_length * 10 <= sizeof buffer);
 
-	const size_t len = matcher.word_length();
+	std::vector<Query> ret;
+	const auto add = [&ret, &opts, len, plen, slen](const char *word) {
+		const size_t idx = ret.size();
+		const bool miss = static_cast<size_t>((idx + 1) * opts.miss) !=
+			static_cast<size_t>(idx * opts.miss);
+		if (!miss) {
+			ret.emplace_back(std::string_view(word, plen),
+			                 std::string_view(word + len - slen, slen));
+		} else if (slen) {
+			ret.emplace_back(std::string_view(word, plen),
+			                 std::string_view(word + 2 * len - slen,
+			                                  slen));
+		} else {
+			ret.emplace_back(std::string_view(word + 1, plen),
+			                 std::string_view());
+		}
+	};
+	if (!opts.zipf) {
+		for (size_t i = 0; i < 20; ++i) {
+			add(buffer + i * std::max<size_t>(len / 5, 1));
+		}
+		return ret;
+	}
+
+	constexpr size_t distinct = 1 << 16, samples = 1 << 16;
+	static_assert(max_word_length * 2 + distinct <= sizeof buffer);
+	std::vector<double> cdf(distinct);
+	double total = 0;
+	for (size_t i = 0; i < distinct; ++i) {
+		cdf[i] = total += std::pow(i + 1, -opts.zipf);
+	}
+	std::mt19937_64 gen(42);
+	std::uniform_real_distribution<double> distrib(0, total);
+	ret.reserve(samples);
+	for (size_t i = 0; i < samples; ++i) {
+		const size_t rank = std::upper_bound(
+			cdf.begin(), cdf.end() - 1, distrib(gen)) - cdf.begin();
+		add(buffer + rank);
+	}
+	return ret;
+}
+
+
+/* Runs reps repetitions of 20 queries each taken in turn from queries
+   starting at pos.  Updates pos and returns the sum of results of the
+   last repetition. */
+template <class Matcher>
+static size_t run_bench(const Matcher &matcher,
+                        const std::vector<Query> &queries, size_t &pos,
+                        size_t limit, size_t reps) {
 	size_t sum;
 	do {
 		sum = 0;
 		for (size_t i = 0; i < 20; ++i) {
-			const char *const word = buffer +
-				i * std::max<size_t>(len / 5, 1);
-			const std::string_view prefix(word, plen);
-			const std::string_view suffix(word + len - slen, slen);
+			const auto [prefix, suffix] = queries[pos];
+			pos = pos + 1 == queries.size() ? 0 : pos + 1;
 			const auto ignore = [](uint32_t){};
-			sum += matcher.query(prefix, suffix, ignore);
+			sum += matcher.query(prefix, suffix, ignore, limit);
 		}
 	} while (--reps);
 	return sum;
@@ -97,26 +376,21 @@ static size_t run_bench(const Matcher &matcher,
 
 
 template <class Matcher>
-static void run_bench(const char *name, const Matcher &matcher,
-                      size_t plen, size_t slen) {
-	printf("%-14s %8zu×%-8zu %8zu…%-8zu",
-	       name, matcher.size(), matcher.word_length(), plen, slen);
-	fflush(stdout);
-
+static double time_bench(const Matcher &matcher,
+                         const std::vector<Query> &queries,
+                         size_t limit, size_t &sum, size_t &reps) {
 	struct timespec start, end;
-	for (size_t reps = 1;; reps = std::min<size_t>(reps, max_reps)) {
+	size_t pos = 0;
+	for (reps = 1;; reps = std::min<size_t>(reps, max_reps)) {
 		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 
-		const size_t sum = run_bench(matcher, plen, slen, reps);
+		sum = run_bench(matcher, queries, pos, limit, reps);
 
 		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
 		const int64_t ns = nsec(end) - nsec(start);
 
 		if ((reps > 1 && ns > min_time_ns) || reps >=  max_reps) {
-			const double us = ns / static_cast<double>(1000 * reps);
-			printf(" %12.3f µs (%zu %zu)\n", us, sum, reps);
-			fflush(stdout);
-			break;
+			return ns / static_cast<double>(1000 * reps);
 		}
 		reps = std::max<size_t>(
 			reps * 2, reps * 110 * min_time_ns / ns / 100);
@@ -124,12 +398,265 @@ static void run_bench(const char *name, const Matcher &matcher,
 }
 
 
+struct WorkerStats {
+	size_t reps;
+	size_t sum;
+	int64_t ns;
+};
+
+/* Runs queries on a single worker thread until stop is set.  Returns
+   number of repetitions (of 20 queries each) made, sum of their results
+   and time it took in nanoseconds. */
+template <class Matcher>
+static WorkerStats run_worker(
+	const Matcher &matcher, const std::vector<Query> &queries,
+	size_t pos, size_t limit,
+	std::barrier<> &barrier, const std::atomic<bool> &stop) {
+	barrier.arrive_and_wait();
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	size_t reps = 0, sum = 0;
+	do {
+		sum += run_bench(matcher, queries, pos, limit, 1);
+		++reps;
+	} while (!stop.load(std::memory_order_relaxed));
+	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+	return { reps, sum, nsec(end) - nsec(start) };
+}
+
+
+/* Runs res.threads worker threads, each pinned to a different CPU, all
+   querying the same matcher.  With --numa the CPUs are those of the node
+   the calling thread was placed on, so the row's label holds. */
+template <class Matcher>
+static void run_throughput(const Options &opts, Result &res,
+                           const Matcher &matcher,
+                           const std::vector<Query> &queries) {
+	std::barrier<> barrier(res.threads + 1);
+	std::atomic<bool> stop(false);
+	std::vector<WorkerStats> stats(res.threads);
+	std::vector<std::thread> workers;
+	workers.reserve(res.threads);
+	const NumaTopology &topology = NumaTopology::get();
+	const std::vector<int> &cpus = opts.numa
+		? topology.cpus(topology.current()) : opts.cpus;
+
+	for (unsigned i = 0; i < res.threads; ++i) {
+		workers.emplace_back([&, i]{
+			const size_t pos = i * queries.size() / res.threads;
+			stats[i] = run_worker(matcher, queries, pos,
+			                      opts.limit, barrier, stop);
+		});
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpus[i % cpus.size()], &set);
+		pthread_setaffinity_np(workers.back().native_handle(),
+		                       sizeof set, &set);
+	}
+
+	barrier.arrive_and_wait();
+	std::this_thread::sleep_for(
+		std::chrono::nanoseconds(static_cast<int64_t>(min_time_ns)));
+	stop.store(true, std::memory_order_relaxed);
+
+	res.qps = res.us = res.max_us = 0;
+	res.reps = 0;
+	for (unsigned i = 0; i < res.threads; ++i) {
+		workers[i].join();
+		const auto [reps, sum, ns] = stats[i];
+		const double us = ns / (1000.0 * reps);
+		res.sum = sum / reps;
+		res.qps += reps * 20 * 1e9 / ns;
+		res.us += us / res.threads;
+		res.max_us = std::max(res.max_us, us);
+		res.reps += reps;
+	}
+}
+
+
+template <class Matcher>
+static void measure(const Options &opts, Result &res,
+                    const Matcher &matcher,
+                    const std::vector<Query> &queries) {
+	if (res.threads) {
+		run_throughput(opts, res, matcher, queries);
+		res.stddev_us = 0;
+		return;
+	}
+
+	double total = 0, total_sq = 0;
+	for (unsigned i = 0; i < opts.repeat; ++i) {
+		const double us = time_bench(matcher, queries, opts.limit,
+		                             res.sum, res.reps);
+		total += us;
+		total_sq += us * us;
+	}
+	res.us = total / opts.repeat;
+	res.stddev_us = std::sqrt(std::max(
+		0.0, total_sq / opts.repeat - res.us * res.us));
+}
+
+
+/* Times queries one at a time for a quarter of the usual measurement
+   time and records median and 99th percentile latency in res. */
+template <class Matcher>
+static void measure_latency(const Options &opts, Result &res,
+                            const Matcher &matcher,
+                            const std::vector<Query> &queries) {
+	constexpr size_t max_samples = 1 << 22;
+	std::vector<int64_t> samples;
+	samples.reserve(max_samples);
+
+	const auto ignore = [](uint32_t){};
+	struct timespec begin, start, end;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &begin);
+	for (size_t pos = 0; samples.size() < max_samples;
+	     pos = pos + 1 == queries.size() ? 0 : pos + 1) {
+		const auto [prefix, suffix] = queries[pos];
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		const size_t n = matcher.query(prefix, suffix, ignore,
+		                               opts.limit);
+		/* Keep the compiler from dropping a query it can see has no
+		   side effects. */
+		asm volatile("" : : "g"(n) : "memory");
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+		samples.push_back(nsec(end) - nsec(start));
+		if (nsec(end) - nsec(begin) > min_time_ns / 4) {
+			break;
+		}
+	}
+
+	const auto percentile = [&samples](double p) {
+		const auto it = samples.begin() +
+			static_cast<size_t>((samples.size() - 1) * p);
+		std::nth_element(samples.begin(), it, samples.end());
+		return *it / 1000.0;
+	};
+	res.p50_us = percentile(0.5);
+	res.p99_us = percentile(0.99);
+}
+
+
+/* Runs every query once more with work counters and records their sum
+   in res.  Counting is kept out of the timed runs so it does not skew
+   them. */
+template <class Matcher>
+static void count_work(const Options &opts, Result &res,
+                       const Matcher &matcher,
+                       const std::vector<Query> &queries) {
+	res.work = QueryStats();
+	res.queries = 0;
+	if constexpr (requires (QueryStats &stats, void (&cb)(uint32_t)) {
+			matcher.query("", "", cb, 0, stats);
+		}) {
+		const auto ignore = [](uint32_t){};
+		for (const auto &[prefix, suffix] : queries) {
+			matcher.query(prefix, suffix, ignore, opts.limit,
+			              res.work);
+		}
+		res.queries = queries.size();
+	}
+}
+
+
+/* Whether Matcher supports queries tolerating mismatches. */
+template <class Matcher>
+static constexpr bool has_query_approx =
+	requires (const Matcher &matcher, void (&cb)(uint32_t)) {
+		matcher.query_approx("", "", 1, cb);
+	};
+
+/* Presents query_approx with fixed number of mismatches as query so it
+   can be measured like any other matcher. */
+template <class Matcher>
+struct ApproxQuery {
+	const Matcher &matcher;
+	const size_t mismatches;
+
+	template <class Callback>
+	size_t query(std::string_view prefix, std::string_view suffix,
+	             Callback &cb, size_t limit) const {
+		return matcher.query_approx(prefix, suffix, mismatches,
+		                            cb, limit);
+	}
+};
+
+
+template <class Matcher>
+static bool run_bench(const Options &opts, Result &res,
+                      const Matcher &matcher) {
+	if constexpr (has_query_approx<Matcher>) {
+		/* Approximate queries are run for every requested number of
+		   mismatches with /k<n> appended to the name. */
+		if (!opts.mismatches.empty()) {
+			const char *const name = res.name;
+			bool ok = true;
+			for (const size_t k : opts.mismatches) {
+				const std::string approx =
+					name + ("/k" + std::to_string(k));
+				res.name = approx.c_str();
+				ok = run_bench(opts, res, ApproxQuery<Matcher>{
+						matcher, k}) && ok;
+			}
+			res.name = name;
+			return ok;
+		}
+	}
+
+	const std::vector<Query> queries =
+		make_queries(opts, res.length, res.plen, res.slen);
+
+	bool ok = true;
+	for (size_t i = 0; i < std::max<size_t>(opts.threads.size(), 1); ++i) {
+		res.threads = opts.threads.empty() ? 0 : opts.threads[i];
+		print_head(opts, res);
+		if constexpr (requires { matcher.stats(); }) {
+			/* Hit rate of queries made in this measurement only. */
+			const CacheStats before = matcher.stats();
+			measure(opts, res, matcher, queries);
+			const CacheStats after = matcher.stats();
+			const double hits = after.hits - before.hits;
+			res.cached = true;
+			res.hit_rate = hits / std::max(
+				1.0, hits + (after.misses - before.misses));
+		} else {
+			measure(opts, res, matcher, queries);
+		}
+		if (opts.stats) {
+			count_work(opts, res, matcher, queries);
+		}
+		if (opts.latency || opts.reload) {
+			if constexpr (requires { matcher.generation(); }) {
+				const size_t before = matcher.generation();
+				measure_latency(opts, res, matcher, queries);
+				res.reloads = matcher.generation() - before;
+			} else {
+				measure_latency(opts, res, matcher, queries);
+			}
+		}
+		ok = print_tail(opts, res) && ok;
+	}
+	return ok;
+}
+
+
 template <class Matcher>
-static void run_bench(const char *name, const Matcher &matcher) {
-	const size_t len = matcher.word_length();
+static bool run_grid(const Options &opts, Result &res,
+                     const Matcher &matcher) {
+	res.bytes = matcher.memory_usage();
+
+	bool ok = true;
+	const size_t len = res.length;
 	for (size_t plen = len;; plen /= 10) {
 		for (size_t slen = std::min(plen, len - plen);; slen /= 10) {
-			run_bench(name, matcher, plen, slen);
+			if (wanted(opts.plens, plen) &&
+			    wanted(opts.slens, slen)) {
+				res.plen = plen;
+				res.slen = slen;
+				ok = run_bench(opts, res, matcher) && ok;
+			}
 			if (!slen) {
 				break;
 			}
@@ -138,40 +665,479 @@ static void run_bench(const char *name, const Matcher &matcher) {
 			break;
 		}
 	}
+	return ok;
 }
 
 
+/* Keeps rebuilding matcher's index from words in a background thread
+   until destroyed, so queries are measured while reloads happen. */
 template <class Matcher>
-static void run_bench(const char *name) {
-	for (size_t count = max_count; count; count /= 10) {
+struct Reloader {
+	Reloader(const Options &opts, Matcher &matcher, const Words &words) {
+		if constexpr (requires { matcher.reload(words); }) {
+			if (opts.reload) {
+				thread = std::thread([this, &matcher, &words] {
+					while (!stop.load()) {
+						matcher.reload(words);
+						matcher.wait();
+					}
+				});
+			}
+		}
+	}
+
+	~Reloader() {
+		stop.store(true);
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+private:
+	std::atomic<bool> stop = false;
+	std::thread thread;
+};
+
+
+template <class Matcher, class... Args>
+static bool run_bench(const Options &opts, Result &res,
+                      const Words &words, Args... args) {
+	if (!opts.numa) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		Matcher matcher(words, args...);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+		res.build_ns = nsec(end) - nsec(start);
+		const Reloader<Matcher> reloader(opts, matcher, words);
+		return run_grid(opts, res, std::as_const(matcher));
+	}
+
+	/* Build the matcher with memory bound to each node in turn and query
+	   it from each node.  Appends @mem<node>/cpu<node> to the name. */
+	const NumaTopology &topology = NumaTopology::get();
+	const char *const name = res.name;
+	bool ok = true;
+	for (size_t mem = 0; mem < topology.size(); ++mem) {
+		std::unique_ptr<const Matcher> matcher;
+		topology.run_on(mem, true, [&]{
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+			matcher = std::make_unique<const Matcher>(
+				words, args...);
+			clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+			res.build_ns = nsec(end) - nsec(start);
+		});
+
+		for (size_t cpu = 0; cpu < topology.size(); ++cpu) {
+			const std::string placed = name +
+				("@mem" + std::to_string(topology.id(mem)) +
+				 "/cpu" + std::to_string(topology.id(cpu)));
+			res.name = placed.c_str();
+			topology.run_on(cpu, false, [&]{
+				ok = run_grid(opts, res, *matcher) && ok;
+			});
+		}
+	}
+	res.name = name;
+	return ok;
+}
+
+
+template <class Matcher>
+static bool run_bench(const Options &opts, Result &res) {
+	if (opts.skew) {
+		generate_rand_data();
+		skew_rand_data(res.count, res.length, opts.skew);
+	}
+	const Words words(buffer, res.count, res.length);
+	if constexpr (requires { Matcher::default_budget; }) {
+		return run_bench<Matcher>(opts, res, words, opts.cache
+		                          ? opts.cache : Matcher::default_budget);
+	} else if constexpr (requires { Matcher::default_bits_per_key; }) {
+		return run_bench<Matcher>(
+			opts, res, words, opts.filter
+			? opts.filter : Matcher::default_bits_per_key);
+	} else if constexpr (requires { Matcher::default_threshold; }) {
+		return run_bench<Matcher>(
+			opts, res, words, opts.parallel
+			? opts.parallel : Matcher::default_threshold);
+	} else if constexpr (!requires (const Matcher &m) { m.shard_count(); }) {
+		return run_bench<Matcher>(opts, res, words);
+	} else {
+		/* Sharded matchers are run for every requested shard count
+		   with the count appended to the name. */
+		const char *const name = res.name;
+		bool ok = true;
+		for (const size_t shards : opts.shards) {
+			const std::string sharded =
+				name + ('/' + std::to_string(shards));
+			res.name = sharded.c_str();
+			ok = run_bench<Matcher>(opts, res, words, shards) && ok;
+		}
+		res.name = name;
+		return ok;
+	}
+}
+
+
+template <class Matcher>
+static bool run_bench(const Options &opts, const char *name) {
+	if constexpr (!has_query_approx<Matcher>) {
+		if (!opts.mismatches.empty()) {
+			return true;
+		}
+	}
+
+	std::vector<size_t> counts = opts.counts;
+	if (counts.empty()) {
+		for (size_t count = max_count; count; count /= 10) {
+			counts.push_back(count);
+		}
+	}
+
+	/* Limited, Zipf, miss-heavy and skewed runs are told apart by
+	   /limit<n>, /zipf<s>, /miss<f> and /skew<f> appended to the
+	   name. */
+	std::string limited = name;
+	if (opts.limit != SIZE_MAX) {
+		limited += "/limit" + std::to_string(opts.limit);
+	}
+	if (opts.zipf) {
+		char buf[32];
+		snprintf(buf, sizeof buf, "/zipf%g", opts.zipf);
+		limited += buf;
+	}
+	if (opts.miss) {
+		char buf[32];
+		snprintf(buf, sizeof buf, "/miss%g", opts.miss);
+		limited += buf;
+	}
+	if (opts.skew) {
+		char buf[32];
+		snprintf(buf, sizeof buf, "/skew%g", opts.skew);
+		limited += buf;
+	}
+
+	bool ok = true;
+	Result res = {};
+	res.name = limited.c_str();
+	for (const size_t count : counts) {
+		res.count = count;
+		if (!opts.lengths.empty()) {
+			for (const size_t len : opts.lengths) {
+				if (count * len <= sizeof buffer) {
+					res.length = len;
+					ok = run_bench<Matcher>(opts, res) && ok;
+				}
+			}
+			continue;
+		}
 		for (size_t len = max_length(count); len; len /= 10) {
-			const Matcher matcher(Words(buffer, count, len));
-			run_bench(name, matcher);
+			res.length = len;
+			ok = run_bench<Matcher>(opts, res) && ok;
+		}
+	}
+	return ok;
+}
+
+
+struct Engine {
+	const char *id;
+	const char *name;
+	bool (*run)(const Options &opts, const char *name);
+};
+
+static const Engine engines[] = {
+#define ENGINE(id, name, type) { id, name, run_bench<type> },
+	FOR_EACH_ENGINE(ENGINE)
+#undef ENGINE
+};
+
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s [<option>...]\n"
+	        "  --engine <id>,...    engines to run (default: all)\n"
+	        "  --count <n>,...      number of words (default: full grid)\n"
+	        "  --len <n>,...        word lengths (default: full grid)\n"
+	        "  --plen <n>,...       only run given prefix lengths\n"
+	        "  --slen <n>,...       only run given suffix lengths\n"
+	        "  --format <fmt>       output format: text, csv or json\n"
+	        "  --repeat <n>         number of measurements to average\n"
+	        "  --baseline <file>    CSV file to compare results against\n"
+	        "  --threshold <pct>    minimum regression threshold (5%%)\n"
+	        "  --threads <n>,...|all\n"
+	        "                       measure throughput of n threads\n"
+	        "                       sharing one matcher\n"
+	        "  --shards <n>,...     shard counts for sharded engines\n"
+	        "  --numa               build on and query from every pair\n"
+	        "                       of NUMA nodes\n"
+	        "  --limit <n>          stop each query after n results\n"
+	        "  --zipf <s>           draw queries from a Zipf distribution\n"
+	        "                       with exponent s\n"
+	        "  --cache <bytes>      memory budget of caching engines\n"
+	        "  --miss <fraction>    fraction of queries made to miss\n"
+	        "  --skew <fraction>    fraction of words made to share\n"
+	        "                       the first half of the first one\n"
+	        "  --filter <bits>      Bloom filter bits per key of\n"
+	        "                       filtering engines\n"
+	        "  --parallel <n>       estimated result size from which\n"
+	        "                       parallel engines split queries\n"
+	        "  --mismatches <k>,... run queries tolerating k mismatches\n"
+	        "                       on engines which support them\n"
+	        "  --stats              report work done per query\n"
+	        "  --latency            report median and p99 latency of\n"
+	        "                       single queries\n"
+	        "  --reload             keep reloading index of reloadable\n"
+	        "                       engines while measuring latency\n"
+	        "engines:", argv0);
+	for (const Engine &engine : engines) {
+		fprintf(stderr, " %s", engine.id);
+	}
+	fputc('\n', stderr);
+}
+
+
+static std::vector<std::string> split(const char *arg) {
+	std::vector<std::string> ret;
+	for (const char *comma; (comma = strchr(arg, ','));) {
+		ret.emplace_back(arg, comma);
+		arg = comma + 1;
+	}
+	ret.emplace_back(arg);
+	return ret;
+}
+
+static bool parse_number(const std::string &arg, double &ret) {
+	char *end;
+	ret = strtod(arg.c_str(), &end);
+	return !arg.empty() && !*end && ret >= 0;
+}
+
+static bool parse_sizes(const char *arg, std::vector<size_t> &ret) {
+	for (const std::string &str : split(arg)) {
+		double value;
+		if (!parse_number(str, value) || value != std::floor(value)) {
+			return false;
+		}
+		ret.push_back(value);
+	}
+	return true;
+}
+
+static bool load_baseline(const char *path, std::map<Key, double> &ret) {
+	FILE *const fd = fopen(path, "r");
+	if (!fd) {
+		perror(path);
+		return false;
+	}
+	/* Only the first six fields are used; whatever follows them, if
+	   anything, is ignored.  So is the header row. */
+	char line[1024], name[64];
+	size_t count, length, plen, slen;
+	double us;
+	bool ok = true, head = true;
+	while (ok && fgets(line, sizeof line, fd)) {
+		const bool whole = strchr(line, '\n') || feof(fd);
+		if (!whole) {
+			/* Skip the rest of an overlong line. */
+			int ch;
+			while ((ch = getc(fd)) != EOF && ch != '\n') {}
+		}
+		if (head && !strncmp(line, "name,", 5)) {
+			head = false;
+			continue;
+		}
+		head = false;
+		ok = sscanf(line, "%63[^,],%zu,%zu,%zu,%zu,%lf",
+		            name, &count, &length, &plen, &slen, &us) == 6;
+		if (ok) {
+			auto [it, inserted] = ret.emplace(
+				Key(name, count, length, plen, slen), us);
+			if (!inserted) {
+				it->second = std::min(it->second, us);
+			}
 		}
 	}
+	ok = ok && !ferror(fd);
+	if (!ok) {
+		fprintf(stderr, "%s: malformed baseline\n", path);
+	}
+	fclose(fd);
+	return ok;
 }
 
 
-static void fix_name(std::string &name) {
-	if (size_t pos = name.find("Matcher"); pos != std::string::npos) {
-		name.erase(pos, 7);
+static bool parse_args(int argc, char **argv, Options &opts) {
+	cpu_set_t set;
+	if (!sched_getaffinity(0, sizeof set, &set)) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &set)) {
+				opts.cpus.push_back(cpu);
+			}
+		}
 	}
-	if (size_t pos = name.find("<Trie"); pos != std::string::npos) {
-		name.erase(pos + 1, 4);
+	if (opts.cpus.empty()) {
+		opts.cpus.push_back(0);
 	}
-	if (size_t pos = name.find("Storage>"); pos != std::string::npos) {
-		name.erase(pos, 7);
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view opt = argv[i];
+		const char *const arg = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (opt == "--help" || opt == "-h") {
+			return false;
+		} else if (opt == "--numa") {
+			opts.numa = true;
+			continue;
+		} else if (opt == "--stats") {
+			opts.stats = true;
+			continue;
+		} else if (opt == "--latency") {
+			opts.latency = true;
+			continue;
+		} else if (opt == "--reload") {
+			opts.reload = true;
+			continue;
+		} else if (!arg) {
+			fprintf(stderr, "%s: missing argument\n", argv[i]);
+			return false;
+		}
+		++i;
+
+		bool ok = true;
+		double value;
+		if (opt == "--engine") {
+			for (const std::string &id : split(arg)) {
+				const auto it = std::find_if(
+					std::begin(engines), std::end(engines),
+					[&id](const Engine &engine) {
+						return id == engine.id;
+					});
+				if (it == std::end(engines)) {
+					fprintf(stderr, "%s: unknown engine\n",
+					        id.c_str());
+					return false;
+				}
+				opts.engines.push_back(it->id);
+			}
+		} else if (opt == "--count") {
+			ok = parse_sizes(arg, opts.counts);
+		} else if (opt == "--len") {
+			ok = parse_sizes(arg, opts.lengths);
+		} else if (opt == "--plen") {
+			ok = parse_sizes(arg, opts.plens);
+		} else if (opt == "--slen") {
+			ok = parse_sizes(arg, opts.slens);
+		} else if (opt == "--format") {
+			const std::string_view fmt = arg;
+			opts.format = fmt == "csv" ? Format::csv
+				: fmt == "json" ? Format::json
+				: Format::text;
+			ok = fmt == "csv" || fmt == "json" || fmt == "text";
+		} else if (opt == "--repeat") {
+			ok = parse_number(arg, value) && value >= 1;
+			opts.repeat = value;
+		} else if (opt == "--baseline") {
+			if (!load_baseline(arg, opts.baseline)) {
+				return false;
+			}
+		} else if (opt == "--threshold") {
+			ok = parse_number(arg, value);
+			opts.threshold = value / 100;
+		} else if (opt == "--limit") {
+			ok = parse_number(arg, value) &&
+				value == std::floor(value);
+			opts.limit = value;
+		} else if (opt == "--zipf") {
+			ok = parse_number(arg, value) && value > 0;
+			opts.zipf = value;
+		} else if (opt == "--cache") {
+			ok = parse_number(arg, value) && value >= 1;
+			opts.cache = value;
+		} else if (opt == "--miss") {
+			ok = parse_number(arg, value) && value >= 0 && value <= 1;
+			opts.miss = value;
+		} else if (opt == "--skew") {
+			ok = parse_number(arg, value) && value >= 0 && value <= 1;
+			opts.skew = value;
+		} else if (opt == "--mismatches") {
+			ok = parse_sizes(arg, opts.mismatches);
+		} else if (opt == "--filter") {
+			ok = parse_number(arg, value) && value >= 1;
+			opts.filter = value;
+		} else if (opt == "--parallel") {
+			ok = parse_number(arg, value) && value >= 1;
+			opts.parallel = value;
+		} else if (opt == "--shards") {
+			ok = parse_sizes(arg, opts.shards) &&
+				std::find(opts.shards.begin(),
+				          opts.shards.end(), 0) ==
+				opts.shards.end();
+		} else if (opt == "--threads") {
+			if (std::string_view(arg) == "all") {
+				for (size_t n = 1; n <= opts.cpus.size(); ++n) {
+					opts.threads.push_back(n);
+				}
+			} else {
+				ok = parse_sizes(arg, opts.threads) &&
+					std::find(opts.threads.begin(),
+					          opts.threads.end(), 0) ==
+					opts.threads.end();
+			}
+		} else {
+			fprintf(stderr, "%s: unknown option\n", argv[i - 1]);
+			return false;
+		}
+
+		if (!ok) {
+			fprintf(stderr, "%s: invalid argument: %s\n",
+			        argv[i - 1], arg);
+			return false;
+		}
 	}
+
+	if (opts.shards.empty()) {
+		opts.shards.push_back(opts.cpus.size());
+	}
+	for (const size_t count : opts.counts) {
+		if (count > max_count || !count) {
+			fprintf(stderr, "%zu: invalid count\n", count);
+			return false;
+		}
+	}
+	for (const size_t len : opts.lengths) {
+		if (len > max_word_length || !len) {
+			fprintf(stderr, "%zu: invalid length\n", len);
+			return false;
+		}
+	}
+	return true;
 }
 
 
-#define STRINGIFY(s) STRINGIFY_INTERNAL(s)
-#define STRINGIFY_INTERNAL(s) #s
+int main(int argc, char **argv) {
+	Options opts;
+	if (!parse_args(argc, argv, opts)) {
+		usage(argv[0]);
+		return 2;
+	}
 
-int main() {
 	generate_rand_data();
-	std::string name(STRINGIFY(MATCHER));
-	fix_name(name);
-	run_bench<MATCHER>(name.c_str());
-	return 0;
+	if (opts.format == Format::json) {
+		fputs("[", stdout);
+	}
+
+	bool ok = true;
+	for (const Engine &engine : engines) {
+		if (opts.engines.empty() ||
+		    std::find(opts.engines.begin(), opts.engines.end(),
+		              engine.id) != opts.engines.end()) {
+			ok = engine.run(opts, engine.name) && ok;
+		}
+	}
+
+	if (opts.format == Format::json) {
+		fputs("]\n", stdout);
+	}
+	return !ok;
 }
@@ -0,0 +1,248 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_BIFM_MATCHER_H
+#define H_BIFM_MATCHER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bit-vector.h"
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "util.h"
+#include "wavelet-matrix.h"
+#include "words.h"
+
+
+/* FM-index over the words.  Every word w is taken as a cycle "`w" and
+   all rotations of all the cycles are sorted; the index keeps the last
+   column of that matrix (the extended Burrows–Wheeler transform) in
+   a wavelet matrix, five bits per character plus rank directories.
+
+   Since a cycle wraps around, rotations starting at the suffix continue
+   with '`' and then the prefix of the same word.  A single backward
+   search for suffix, '`', prefix therefore extends the match across the
+   word boundary and finds the words which end with the suffix and start
+   with the prefix.  Rows starting with '`' come first, one per word in
+   sorted order, so each match is mapped to a word by stepping back with
+   LF until it reaches one of them or, for long words, one of the rows
+   sampled every sample_rate characters. */
+struct BiFmMatcher {
+	static constexpr size_t sample_rate = 32;
+
+	BiFmMatcher(const Words &words) COLD
+		: BiFmMatcher(words, Rotations(words)) {}
+
+	size_t size() const { return ids.size(); }
+	size_t word_length() const { return length; }
+	size_t memory_usage() const {
+		return sizeof *this + bwt.memory_usage() +
+			sampled.memory_usage() +
+			samples.capacity() * sizeof samples[0] +
+			ids.capacity() * sizeof ids[0];
+	}
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const HOT;
+
+	QueryCursor<BiFmMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+private:
+	/* All words as cycles, one after another, and their rotations in
+	   sorted order, each given as position of its first character. */
+	struct Rotations {
+		explicit Rotations(const Words &words) COLD;
+
+		size_t cycle;
+		std::string text;
+		std::vector<size_t> rows;
+	};
+
+	BiFmMatcher(const Words &words, const Rotations &rotations) COLD;
+
+	/* '`' is 0 and letters are 1…26. */
+	static constexpr uint8_t code(char ch) { return ch - '`'; }
+
+	/* Narrows [lo, hi) rows to those preceded by sym. */
+	bool extend(size_t &lo, size_t &hi, uint8_t sym) const HOT {
+		lo = first[sym] + bwt.rank(sym, lo);
+		hi = first[sym] + bwt.rank(sym, hi);
+		return lo < hi;
+	}
+
+	size_t word_rank(size_t row) const HOT;
+
+	static std::vector<uint8_t> last_column(const Rotations &rotations)
+		COLD;
+
+	const WaveletMatrix<5> bwt;
+	/* Number of rows starting with a symbol smaller than given one. */
+	size_t first[28] = {};
+	/* Rows sampled apart from the ones starting with '`' and word ranks
+	   they belong to.  Empty if words are shorter than sample_rate. */
+	BitVector sampled;
+	std::vector<uint32_t> samples;
+	/* Word ids in sorted order. */
+	std::vector<uint32_t> ids;
+	const size_t length;
+
+	BiFmMatcher() = delete;
+	BiFmMatcher(const BiFmMatcher&) = delete;
+};
+
+
+inline BiFmMatcher::Rotations::Rotations(const Words &words)
+	: cycle(words.word_length() + 1) {
+	text.reserve(words.size() * cycle);
+	for (const auto &entry : words) {
+		text.push_back('`');
+		text.append(entry.first);
+	}
+
+	rows.resize(text.size());
+	for (size_t i = 0; i < rows.size(); ++i) {
+		rows[i] = i;
+	}
+
+	/* Compares two rotations piece by piece, each piece ending where
+	   either of the cycles wraps around. */
+	const char *const data = text.data();
+	const size_t len = cycle;
+	std::sort(rows.begin(), rows.end(), [data, len](size_t a, size_t b) {
+		const char *const base_a = data + a / len * len;
+		const char *const base_b = data + b / len * len;
+		size_t off_a = a % len, off_b = b % len;
+		for (size_t done = 0; done < len;) {
+			const size_t n = std::min(len - std::max(off_a, off_b),
+			                          len - done);
+			const int cmp = memcmp(base_a + off_a, base_b + off_b, n);
+			if (cmp) {
+				return cmp < 0;
+			}
+			done += n;
+			off_a = (off_a + n) % len;
+			off_b = (off_b + n) % len;
+		}
+		return false;
+	});
+}
+
+
+inline std::vector<uint8_t>
+BiFmMatcher::last_column(const Rotations &rotations) {
+	const size_t cycle = rotations.cycle;
+	std::vector<uint8_t> ret;
+	ret.reserve(rotations.rows.size());
+	for (const size_t pos : rotations.rows) {
+		const size_t prev = pos % cycle ? pos - 1 : pos + cycle - 1;
+		ret.push_back(code(rotations.text[prev]));
+	}
+	return ret;
+}
+
+
+inline BiFmMatcher::BiFmMatcher(const Words &words,
+                                const Rotations &rotations)
+	: bwt(last_column(rotations)), length(words.word_length()) {
+	const size_t cycle = rotations.cycle;
+	for (const size_t pos : rotations.rows) {
+		++first[code(rotations.text[pos]) + 1];
+	}
+	for (size_t sym = 1; sym < std::size(first); ++sym) {
+		first[sym] += first[sym - 1];
+	}
+
+	if (cycle > sample_rate) {
+		for (const size_t pos : rotations.rows) {
+			const size_t off = pos % cycle;
+			const bool sample = off && off % sample_rate == 0;
+			sampled.push_back(sample);
+			if (sample) {
+				samples.push_back(pos / cycle);
+			}
+		}
+		sampled.build();
+	}
+
+	ids.reserve(words.size());
+	for (const auto &entry : words) {
+		ids.push_back(entry.second);
+	}
+}
+
+
+/* Returns sorted rank of the word row belongs to. */
+inline size_t BiFmMatcher::word_rank(size_t row) const {
+	while (row >= ids.size()) {
+		if (sampled.size() && sampled[row]) {
+			return samples[sampled.rank1(row)];
+		}
+		const auto [sym, rank] = bwt.access_rank(row);
+		row = first[sym] + rank;
+	}
+	return row;
+}
+
+
+template <class Callback, class Stats>
+size_t BiFmMatcher::query(std::string_view prefix,
+                          std::string_view suffix,
+                          Callback &cb, size_t limit,
+                          Stats &&stats) const {
+	if (prefix.size() + suffix.size() > length) {
+		return 0;
+	}
+
+	/* Pattern is suffix, '`', prefix; backward search goes from its
+	   end. */
+	size_t lo = 0, hi = bwt.size();
+	for (auto it = prefix.rbegin(); it != prefix.rend(); ++it) {
+		stats.follow();
+		if (!extend(lo, hi, code(*it))) {
+			return 0;
+		}
+	}
+	stats.follow();
+	if (!extend(lo, hi, 0)) {
+		return 0;
+	}
+	for (auto it = suffix.rbegin(); it != suffix.rend(); ++it) {
+		stats.follow();
+		if (!extend(lo, hi, code(*it))) {
+			return 0;
+		}
+	}
+
+	size_t count = 0;
+	for (; lo < hi && count < limit; ++lo, ++count) {
+		cb(ids[word_rank(lo)]);
+	}
+	stats.emit(count);
+	return count;
+}
+
+
+#endif
@@ -0,0 +1,189 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_BIT_VECTOR_H
+#define H_BIT_VECTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#ifdef __BMI2__
+#  include <immintrin.h>
+#endif
+
+#include "util.h"
+
+
+/* Returns number of set bits in each byte of word. */
+constexpr uint64_t byte_counts(uint64_t word) {
+	word -= word >> 1 & UINT64_C(0x5555555555555555);
+	word = (word & UINT64_C(0x3333333333333333)) +
+		(word >> 2 & UINT64_C(0x3333333333333333));
+	return (word + (word >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+}
+
+/* Without popcnt instruction __builtin_popcountll is a library call; the
+   broadword version is much faster than that. */
+inline unsigned popcount(uint64_t word) {
+#ifdef __POPCNT__
+	return __builtin_popcountll(word);
+#else
+	return byte_counts(word) * UINT64_C(0x0101010101010101) >> 56;
+#endif
+}
+
+
+/* Append-only bit vector supporting rank and select of zero bits.  Once
+   all bits are pushed, build() creates the directory: number of zeros
+   before every 512-bit block plus the block holding every 512th zero.
+   rank0() popcounts at most eight words past the block's count;
+   select0() jumps to the sampled block, skips a few blocks and popcounts
+   at most eight words. */
+struct BitVector {
+	void push_back(bool bit) {
+		if (!(count % 64)) {
+			words.push_back(0);
+		}
+		words.back() |= uint64_t(bit) << (count % 64);
+		++count;
+	}
+
+	size_t size() const { return count; }
+
+	bool operator[](size_t pos) const {
+		return words[pos / 64] >> (pos % 64) & 1;
+	}
+
+	void build() COLD;
+
+	/* Returns number of zero bits before pos. */
+	size_t rank0(size_t pos) const HOT {
+		const size_t w = pos / 64;
+		size_t ret = zeros_before[w / block_words];
+		for (size_t i = w / block_words * block_words; i < w; ++i) {
+			ret += popcount(~words[i]);
+		}
+		if (pos % 64) {
+			ret += popcount(~words[w] << (64 - pos % 64));
+		}
+		return ret;
+	}
+
+	/* Returns number of set bits before pos. */
+	size_t rank1(size_t pos) const HOT { return pos - rank0(pos); }
+
+	/* Returns position of the zero bit with given 0-based index. */
+	size_t select0(size_t idx) const HOT;
+
+	/* Returns position of the first zero bit at or after pos. */
+	size_t next0(size_t pos) const HOT {
+		size_t w = pos / 64;
+		uint64_t zeros = ~words[w] >> (pos % 64) << (pos % 64);
+		while (!zeros) {
+			zeros = ~words[++w];
+		}
+		return w * 64 + __builtin_ctzll(zeros);
+	}
+
+	size_t memory_usage() const {
+		return words.capacity() * sizeof words[0] +
+			zeros_before.capacity() * sizeof zeros_before[0] +
+			samples.capacity() * sizeof samples[0];
+	}
+
+private:
+	static constexpr size_t block_words = 8;
+	static constexpr size_t sample_rate = 512;
+
+	/* Returns position of idx-th (0-based) set bit in word. */
+	static unsigned select_in_word(uint64_t word, unsigned idx) {
+#ifdef __BMI2__
+		return __builtin_ctzll(_pdep_u64(uint64_t(1) << idx, word));
+#else
+		/* Byte i of sums is number of set bits in bytes 0…i. */
+		const uint64_t sums =
+			byte_counts(word) * UINT64_C(0x0101010101010101);
+		unsigned shift = 0;
+		while ((sums >> shift & 0xff) <= idx) {
+			shift += 8;
+		}
+		if (shift) {
+			idx -= sums >> (shift - 8) & 0xff;
+		}
+		word >>= shift;
+		for (; idx; --idx) {
+			word &= word - 1;
+		}
+		return shift + __builtin_ctzll(word);
+#endif
+	}
+
+	std::vector<uint64_t> words;
+	std::vector<uint32_t> zeros_before;
+	std::vector<uint32_t> samples;
+	size_t count = 0;
+};
+
+
+inline void BitVector::build() {
+	/* Padding bits past the end are ones so they never count as
+	   zeros. */
+	if (count % 64) {
+		words.back() |= ~uint64_t(0) << (count % 64);
+	}
+	words.shrink_to_fit();
+
+	const size_t blocks = (words.size() + block_words - 1) / block_words;
+	zeros_before.assign(blocks + 1, 0);
+	samples.clear();
+	size_t zeros = 0;
+	for (size_t b = 0; b < blocks; ++b) {
+		zeros_before[b] = zeros;
+		const size_t end = std::min(words.size(), (b + 1) * block_words);
+		for (size_t w = b * block_words; w < end; ++w) {
+			const size_t n = popcount(~words[w]);
+			/* Record block of every sample_rate-th zero. */
+			while (samples.size() * sample_rate < zeros + n) {
+				samples.push_back(b);
+			}
+			zeros += n;
+		}
+	}
+	zeros_before[blocks] = zeros;
+}
+
+
+inline size_t BitVector::select0(size_t idx) const {
+	size_t b = samples[idx / sample_rate];
+	while (zeros_before[b + 1] <= idx) {
+		++b;
+	}
+	idx -= zeros_before[b];
+	size_t w = b * block_words;
+	for (;;) {
+		const size_t n = popcount(~words[w]);
+		if (idx < n) {
+			break;
+		}
+		idx -= n;
+		++w;
+	}
+	return w * 64 + select_in_word(~words[w], idx);
+}
+
+
+#endif
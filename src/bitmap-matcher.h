@@ -17,45 +17,66 @@
 #ifndef H_BITMAP_MATCHER_H
 #define H_BITMAP_MATCHER_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "front-coded-map.h"
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "result-sink.h"
 #include "util.h"
 #include "vector-map.h"
 #include "words.h"
 
 
-struct BitmapMatcher {
-	BitmapMatcher(const Words &words)
-		: fwd(words), rev(words.reverse()),
-		  bitmap(new uint64_t[sizeof_bitmap(words.size())]) {}
+/* Map is VectorMap or, to trade speed for memory, FrontCodedMap. */
+template <class Map = VectorMap>
+struct BasicBitmapMatcher {
+	BasicBitmapMatcher(const Words &words)
+		: fwd(words), rev(words.reverse()) {}
 
 
 	size_t size() const { return fwd.size(); }
 	size_t word_length() const { return fwd.key_length(); }
-	template <class Callback>
+	size_t memory_usage() const {
+		return sizeof *this + fwd.memory_usage() + rev.memory_usage() +
+			sizeof_bitmap(size()) * sizeof(uint64_t);
+	}
+	template <class Callback, class Stats = NoStats>
 	inline size_t query(std::string_view prefix,
 	                    std::string_view suffix,
-	                    Callback &cb) const HOT;
+	                    Callback &cb,
+	                    size_t limit = SIZE_MAX,
+	                    Stats &&stats = {}) const HOT;
+
+	QueryCursor<BasicBitmapMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
 
 private:
 	static constexpr uint64_t sizeof_bitmap(size_t count) {
 		return (count + 63) / 64;
 	}
 
-	VectorMap fwd, rev;
-	mutable std::unique_ptr<uint64_t[]> bitmap;
+	Map fwd, rev;
 
-	BitmapMatcher() = delete;
-	BitmapMatcher(const BitmapMatcher&) = delete;
+	BasicBitmapMatcher() = delete;
+	BasicBitmapMatcher(const BasicBitmapMatcher&) = delete;
 };
 
-template <class Callback>
-size_t BitmapMatcher::query(std::string_view prefix,
-                            std::string_view suffix,
-                            Callback &cb) const {
+using BitmapMatcher = BasicBitmapMatcher<>;
+using FrontCodedBitmapMatcher = BasicBitmapMatcher<FrontCodedMap<>>;
+
+
+template <class Map>
+template <class Callback, class Stats>
+size_t BasicBitmapMatcher<Map>::query(std::string_view prefix,
+                                      std::string_view suffix,
+                                      Callback &cb, size_t limit,
+                                      Stats &&stats) const {
 	if (prefix.size() + suffix.size() == word_length() ||
 	    prefix.empty() || suffix.empty()) {
 		const bool isSuffix = prefix.empty() &&
@@ -64,24 +85,32 @@ size_t BitmapMatcher::query(std::string_view prefix,
 		if (isSuffix) {
 			std::reverse(ix.begin(), ix.end());
 		}
-		return (isSuffix ? rev : fwd).for_each_value(ix, cb);
+		const size_t cnt = (isSuffix ? rev : fwd).for_each_value(
+			ix, cb, limit, stats);
+		stats.emit(cnt);
+		return cnt;
 	}
 
-	uint64_t *const bm = bitmap.get();
-	std::memset(bitmap.get(), 0, sizeof_bitmap(size()));
+	/* Bitmap is per thread so concurrent queries are safe. */
+	static thread_local std::vector<uint64_t> bitmap;
+	bitmap.assign(sizeof_bitmap(size()), 0);
+	uint64_t *const bm = bitmap.data();
 
-	fwd.for_each_value(prefix, [bm](uint32_t v) {
+	stats.fan(fwd.for_each_value(prefix, [bm](uint32_t v) {
 		bm[v / 64] |= UINT64_C(1) << (v % 64);
-	});
+	}, SIZE_MAX, stats));
 
 	std::string suffix_str(suffix.rbegin(), suffix.rend());
-	size_t cnt = 0;
-	rev.for_each_value(suffix_str, [&cnt, &cb, bm](uint32_t v) {
-		if (bm[v / 64] & (UINT64_C(1) << (v % 64))) {
-			cb(v);
-			++cnt;
-		}
-	});
+	const auto [first, last] = rev.range(suffix_str, stats);
+	const auto in_prefix = [bm](uint32_t v) {
+		return (bm[v / 64] >> (v % 64)) & 1;
+	};
+	const auto to_id = [](uint32_t v) { return v; };
+	const uint32_t *it = rev.value_ptr(first);
+	const size_t cnt = push_if(cb, it, rev.value_ptr(last), limit,
+	                           in_prefix, to_id);
+	stats.filter(it - rev.value_ptr(first) - cnt);
+	stats.emit(cnt);
 	return cnt;
 }
 
@@ -0,0 +1,83 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_BLOOM_FILTER_H
+#define H_BLOOM_FILTER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+#include "util.h"
+
+
+/* Blocked Bloom filter.  Every key maps to a single 64-byte block (one
+   cache line) and sets one bit in each of its eight 64-bit words, so
+   a lookup costs one memory access no matter how many bits it checks.
+   Keys are given as 64-bit hashes. */
+struct BloomFilter {
+	/* Creates a filter for given number of keys using roughly
+	   bits_per_key bits of memory for each. */
+	BloomFilter(size_t keys, size_t bits_per_key) COLD
+		: count(std::max<size_t>(1, (keys * bits_per_key + 511) / 512)),
+		  blocks(std::make_unique<Block[]>(count)) {}
+
+	void add(uint64_t hash) {
+		Block &block = blocks[index(hash)];
+		const uint64_t bits = mix(hash);
+		for (unsigned i = 0; i < 8; ++i) {
+			block.words[i] |= uint64_t(1) << (bits >> (i * 6) & 63);
+		}
+	}
+
+	bool may_contain(uint64_t hash) const {
+		const Block &block = blocks[index(hash)];
+		const uint64_t bits = mix(hash);
+		/* No early exit; testing all words without branches is
+		   cheaper than mispredicting. */
+		uint64_t missing = 0;
+		for (unsigned i = 0; i < 8; ++i) {
+			missing |= ~block.words[i] >> (bits >> (i * 6) & 63);
+		}
+		return !(missing & 1);
+	}
+
+	size_t memory_usage() const { return sizeof *this + count * 64; }
+
+private:
+	struct alignas(64) Block {
+		uint64_t words[8] = {};
+	};
+
+	const size_t count;
+	const std::unique_ptr<Block[]> blocks;
+
+	/* Maps hash onto [0, count) using its high bits. */
+	size_t index(uint64_t hash) const {
+		return static_cast<unsigned __int128>(hash) * count >> 64;
+	}
+
+	/* Bits selecting positions within the block come from the low half
+	   of the hash, stirred so they don't correlate with the index. */
+	static uint64_t mix(uint64_t hash) {
+		hash ^= hash >> 29;
+		hash *= UINT64_C(0xbf58476d1ce4e5b9);
+		return hash ^ hash >> 32;
+	}
+};
+
+
+#endif
@@ -0,0 +1,213 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef H_BURST_MATCHER_H
+#define H_BURST_MATCHER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "trie.h"
+#include "util.h"
+#include "vector-map.h"
+#include "words.h"
+
+
+/* Burst trie.  Words and reversed words are kept in sorted VectorMaps
+   and a trie over each is built only as deep as needed to split keys
+   into buckets of at most Threshold keys.  A bucket is a contiguous range
+   of the sorted keys so once a walk reaches one the rest of the pattern
+   is matched by bisecting it and the other side is checked with memcmp
+   like VectorMatcher does.  A trie slot holds
+   either a child node or, with bucket_flag set, a bucket number. */
+template <size_t Threshold = 64>
+struct BurstMatcher {
+	BurstMatcher(const Words &words) COLD;
+
+	size_t size() const { return fwd.size(); }
+	size_t word_length() const { return fwd.key_length(); }
+	size_t memory_usage() const {
+		return sizeof *this + fwd.memory_usage() + rev.memory_usage() +
+			nodes.memory_usage() +
+			(fwd_buckets.capacity() + rev_buckets.capacity()) *
+			sizeof(uint32_t);
+	}
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const HOT;
+
+	QueryCursor<BurstMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+private:
+	using value_type = TriePoolStorage::value_type;
+
+	static constexpr uint32_t bucket_flag = 1u << 31;
+
+	static bool is_bucket(value_type data) {
+		return data.as_num() & bucket_flag;
+	}
+
+	value_type build(const VectorMap &keys, std::vector<uint32_t> &buckets,
+	                 size_t lo, size_t hi, size_t depth) COLD;
+
+	/* Calls fn(idx) for index of every key starting with str, having
+	   already matched its first depth characters on the way to node,
+	   until fn returns false. */
+	template <class Fn, class Stats>
+	bool walk(const VectorMap &keys, const std::vector<uint32_t> &buckets,
+	          value_type node, size_t depth, std::string_view str,
+	          const Fn &fn, Stats &stats) const HOT;
+
+	const VectorMap fwd, rev;
+	TriePoolStorage nodes;
+	/* Bucket b covers keys [buckets[b], buckets[b + 1]). */
+	std::vector<uint32_t> fwd_buckets, rev_buckets;
+	value_type fwd_root, rev_root;
+
+	BurstMatcher() = delete;
+	BurstMatcher(const BurstMatcher&) = delete;
+};
+
+
+template <size_t Threshold>
+BurstMatcher<Threshold>::BurstMatcher(const Words &words)
+	: fwd(words), rev(make_reversed(fwd)) {
+	fwd_root = build(fwd, fwd_buckets, 0, fwd.size(), 0);
+	fwd_buckets.push_back(fwd.size());
+	rev_root = build(rev, rev_buckets, 0, rev.size(), 0);
+	rev_buckets.push_back(rev.size());
+}
+
+
+/* Keys in [lo, hi) share their first depth characters.  Since they are
+   sorted, keys under each child are again a contiguous range and buckets
+   are numbered in key order. */
+template <size_t Threshold>
+typename BurstMatcher<Threshold>::value_type
+BurstMatcher<Threshold>::build(const VectorMap &keys,
+                               std::vector<uint32_t> &buckets,
+                               size_t lo, size_t hi, size_t depth) {
+	if (hi - lo <= Threshold || depth == keys.key_length()) {
+		buckets.push_back(lo);
+		return value_type::from_num(bucket_flag | (buckets.size() - 1));
+	}
+	const value_type node = nodes.add_node();
+	while (lo < hi) {
+		const char ch = keys.key(lo)[depth];
+		const size_t next = keys.narrow(lo, hi, depth, ch).second;
+		const value_type child = build(keys, buckets, lo, next,
+		                               depth + 1);
+		nodes.insert(node, &ch, &ch + 1, child);
+		lo = next;
+	}
+	return node;
+}
+
+
+template <size_t Threshold>
+template <class Fn, class Stats>
+bool BurstMatcher<Threshold>::walk(const VectorMap &keys,
+                                   const std::vector<uint32_t> &buckets,
+                                   value_type node, size_t depth,
+                                   std::string_view str,
+                                   const Fn &fn, Stats &stats) const {
+	for (; !is_bucket(node); ++depth) {
+		if (depth >= str.size()) {
+			return nodes.fan_out(node, [&](value_type child) {
+				stats.fan();
+				return walk(keys, buckets, child, depth + 1,
+				            str, fn, stats);
+			});
+		}
+		stats.follow();
+		node = nodes.follow(node, str[depth]);
+		if (!node) {
+			return true;
+		}
+	}
+
+	/* Bucket is sorted so rest of str is matched by bisecting it, down
+	   to a handful of keys which are cheaper to compare directly. */
+	const uint32_t bucket = node.as_num() & ~bucket_flag;
+	size_t lo = buckets[bucket], hi = buckets[bucket + 1];
+	for (; depth < str.size() && hi - lo > 8; ++depth) {
+		std::tie(lo, hi) = keys.narrow(lo, hi, depth, str[depth],
+		                               stats);
+	}
+	const size_t skip = std::min(depth, str.size());
+	for (; lo < hi; ++lo) {
+		stats.compare();
+		if (!std::memcmp(keys.key(lo) + skip, str.data() + skip,
+		                 str.size() - skip) && !fn(lo)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+template <size_t Threshold>
+template <class Callback, class Stats>
+size_t BurstMatcher<Threshold>::query(std::string_view prefix,
+                                      std::string_view suffix,
+                                      Callback &cb, size_t limit,
+                                      Stats &&stats) const {
+	const size_t length = word_length();
+	if (prefix.size() + suffix.size() > length || !limit) {
+		return 0;
+	}
+
+	size_t cnt = 0;
+	if (prefix.size() >= suffix.size()) {
+		const size_t offset = length - suffix.size();
+		walk(fwd, fwd_buckets, fwd_root, 0, prefix, [&](size_t i) {
+			if (std::memcmp(fwd.key(i) + offset,
+			                suffix.data(), suffix.size())) {
+				stats.filter();
+				return true;
+			}
+			cb(fwd.value(i));
+			return ++cnt < limit;
+		}, stats);
+	} else {
+		const std::string reversed(suffix.rbegin(), suffix.rend());
+		walk(rev, rev_buckets, rev_root, 0, reversed, [&](size_t i) {
+			const uint32_t v = rev.value(i);
+			if (std::memcmp(fwd.key(v),
+			                prefix.data(), prefix.size())) {
+				stats.filter();
+				return true;
+			}
+			cb(fwd.value(v));
+			return ++cnt < limit;
+		}, stats);
+	}
+	stats.emit(cnt);
+	return cnt;
+}
+
+
+#endif
@@ -0,0 +1,265 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_CACHED_MATCHER_H
+#define H_CACHED_MATCHER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "util.h"
+#include "words.h"
+
+
+struct CacheStats {
+	uint64_t hits = 0, misses = 0, evictions = 0;
+	size_t entries = 0, bytes = 0;
+
+	double hit_rate() const {
+		return hits ? hits / static_cast<double>(hits + misses) : 0;
+	}
+};
+
+
+/* Wraps Inner matcher with a cache of query results keyed by (prefix,
+   suffix).  The cache is split into shards, each with its own mutex, so
+   threads querying different keys rarely contend.  Every shard gets an
+   equal part of the memory budget and evicts entries with the CLOCK
+   algorithm once it runs out.  Results larger than a quarter of a shard's
+   budget are never cached. */
+template <class Inner>
+struct CachedMatcher {
+	static constexpr size_t default_budget = 64 << 20;
+	static constexpr size_t shard_count = 16;
+
+	CachedMatcher(const Words &words, size_t budget = default_budget) COLD
+		: inner(words), shards(std::make_unique<Shard[]>(shard_count)),
+		  shard_budget(budget / shard_count) {}
+
+	size_t size() const { return inner.size(); }
+	size_t word_length() const { return inner.word_length(); }
+	size_t memory_usage() const {
+		return sizeof *this + sizeof(Shard) * shard_count +
+			inner.memory_usage() + stats().bytes;
+	}
+
+	CacheStats stats() const COLD;
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const HOT;
+
+	QueryCursor<CachedMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+private:
+	struct Entry {
+		const std::string *key = nullptr;
+		std::unique_ptr<uint32_t[]> ids;
+		uint32_t size = 0;
+		bool complete = false;
+		bool referenced = false;
+		size_t bytes = 0;
+	};
+
+	struct alignas(64) Shard {
+		std::mutex mutex;
+		std::unordered_map<std::string, uint32_t> index;
+		std::vector<Entry> slots;
+		std::vector<uint32_t> free;
+		size_t hand = 0, bytes = 0;
+		uint64_t hits = 0, misses = 0, evictions = 0;
+	};
+
+	const Inner inner;
+	const std::unique_ptr<Shard[]> shards;
+	const size_t shard_budget;
+
+	static bool lookup(Shard &shard, const std::string &key,
+	                   std::vector<uint32_t> &ids, size_t limit) HOT;
+	void insert(Shard &shard, const std::string &key,
+	            const std::vector<uint32_t> &ids, bool complete) const;
+	static void evict(Shard &shard);
+	static void remove(Shard &shard, size_t idx);
+
+	CachedMatcher() = delete;
+	CachedMatcher(const CachedMatcher&) = delete;
+};
+
+
+template <class Inner>
+CacheStats CachedMatcher<Inner>::stats() const {
+	CacheStats ret;
+	for (size_t i = 0; i < shard_count; ++i) {
+		Shard &shard = shards[i];
+		const std::lock_guard lock(shard.mutex);
+		ret.hits += shard.hits;
+		ret.misses += shard.misses;
+		ret.evictions += shard.evictions;
+		ret.entries += shard.index.size();
+		ret.bytes += shard.bytes;
+	}
+	return ret;
+}
+
+
+template <class Inner>
+template <class Callback, class Stats>
+size_t CachedMatcher<Inner>::query(std::string_view prefix,
+                                   std::string_view suffix,
+                                   Callback &cb, size_t limit,
+                                   Stats &&stats) const {
+	/* Scratch space is per thread so concurrent queries are safe. */
+	static thread_local std::string key;
+	static thread_local std::vector<uint32_t> ids;
+
+	key.assign(prefix);
+	key.push_back('\0');
+	key.append(suffix);
+	Shard &shard = shards[std::hash<std::string>{}(key) % shard_count];
+
+	ids.clear();
+	if (!lookup(shard, key, ids, limit)) {
+		const auto collect = [](uint32_t id) { ids.push_back(id); };
+		inner.query(prefix, suffix, collect, limit, stats);
+		insert(shard, key, ids, ids.size() < limit);
+	} else {
+		stats.emit(ids.size());
+	}
+
+	/* Callback is called without holding the lock so a slow one does
+	   not hold up other threads. */
+	for (const uint32_t id : ids) {
+		cb(id);
+	}
+	return ids.size();
+}
+
+
+/* Copies cached result to ids if there is one which can answer a query
+   with given limit, i.e. it either holds all matches or at least limit
+   of them. */
+template <class Inner>
+bool CachedMatcher<Inner>::lookup(Shard &shard, const std::string &key,
+                                  std::vector<uint32_t> &ids, size_t limit) {
+	const std::lock_guard lock(shard.mutex);
+	const auto it = shard.index.find(key);
+	if (it != shard.index.end()) {
+		Entry &entry = shard.slots[it->second];
+		if (entry.complete || entry.size >= limit) {
+			entry.referenced = true;
+			++shard.hits;
+			const uint32_t *const data = entry.ids.get();
+			ids.assign(data, data + std::min<size_t>(entry.size,
+			                                         limit));
+			return true;
+		}
+	}
+	++shard.misses;
+	return false;
+}
+
+
+template <class Inner>
+void CachedMatcher<Inner>::insert(Shard &shard, const std::string &key,
+                                  const std::vector<uint32_t> &ids,
+                                  bool complete) const {
+	/* Rough per-entry overhead of the slot and hash map node. */
+	const size_t bytes = sizeof(Entry) + 64 + key.size() +
+		ids.size() * sizeof(uint32_t);
+	if (bytes > shard_budget / 4 || ids.size() > UINT32_MAX) {
+		return;
+	}
+
+	const std::lock_guard lock(shard.mutex);
+	const auto found = shard.index.find(key);
+	if (found != shard.index.end()) {
+		const Entry &entry = shard.slots[found->second];
+		if (entry.complete || (!complete && entry.size >= ids.size())) {
+			/* Another thread got here first. */
+			return;
+		}
+		remove(shard, found->second);
+	}
+	while (shard.bytes && shard.bytes + bytes > shard_budget) {
+		evict(shard);
+	}
+
+	uint32_t idx = shard.slots.size();
+	if (shard.free.empty()) {
+		shard.slots.emplace_back();
+	} else {
+		idx = shard.free.back();
+		shard.free.pop_back();
+	}
+	const auto it = shard.index.emplace(key, idx).first;
+
+	Entry &entry = shard.slots[idx];
+	shard.bytes += bytes;
+	entry.key = &it->first;
+	entry.ids = std::make_unique<uint32_t[]>(ids.size());
+	std::copy(ids.begin(), ids.end(), entry.ids.get());
+	entry.size = ids.size();
+	entry.complete = complete;
+	entry.referenced = false;
+	entry.bytes = bytes;
+}
+
+
+/* Advances the clock hand until it finds an entry which has not been
+   referenced since the hand last passed it and evicts it. */
+template <class Inner>
+void CachedMatcher<Inner>::evict(Shard &shard) {
+	for (;;) {
+		const size_t idx = shard.hand;
+		shard.hand = idx + 1 == shard.slots.size() ? 0 : idx + 1;
+		Entry &entry = shard.slots[idx];
+		if (!entry.key) {
+			continue;
+		} else if (entry.referenced) {
+			entry.referenced = false;
+			continue;
+		}
+		remove(shard, idx);
+		++shard.evictions;
+		return;
+	}
+}
+
+
+template <class Inner>
+void CachedMatcher<Inner>::remove(Shard &shard, size_t idx) {
+	Entry &entry = shard.slots[idx];
+	shard.bytes -= entry.bytes;
+	shard.index.erase(*entry.key);
+	entry = Entry();
+	shard.free.push_back(idx);
+}
+
+
+#endif
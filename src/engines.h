@@ -0,0 +1,97 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_ENGINES_H
+#define H_ENGINES_H
+
+#include "bifm-matcher.h"
+#include "bitmap-matcher.h"
+#include "burst-matcher.h"
+#include "cached-matcher.h"
+#include "filtered-matcher.h"
+#include "index-handle.h"
+#include "fixed-length-matcher.h"
+#include "numa-matcher.h"
+#include "parallel-matcher.h"
+#include "radix-matcher.h"
+#include "sharded-matcher.h"
+#include "trie-double-array.h"
+#include "trie-louds.h"
+#include "trie-matcher.h"
+#include "trie-mix-matcher.h"
+#include "trie-sparse.h"
+#include "vector-matcher.h"
+#include "vector-range-matcher.h"
+
+
+/* List of all matching engines.  For each engine calls X(id, name, type)
+   where id is name used on command line and in Makefile targets, name is
+   used in results and type is the matcher type. */
+#define FOR_EACH_ENGINE(X) \
+	X("bmap",       "Bitmap",         BitmapMatcher) \
+	X("vec",        "Vector",         VectorMatcher) \
+	X("vec-range",  "VectorRange",    VectorRangeMatcher) \
+	X("bmap-fc",    "Bitmap<FC>",     FrontCodedBitmapMatcher) \
+	X("vec-fc",     "Vector<FC>",     FrontCodedVectorMatcher) \
+	X("vec-range-fc", "VectorRange<FC>", FrontCodedVectorRangeMatcher) \
+	X("trie-pool",  "Trie<Pool>",     TrieMatcher<TriePoolStorage>) \
+	X("trie-alloc", "Trie<Alloc>",    TrieMatcher<TrieAllocStorage>) \
+	X("mix-pool",   "TrieMix<Pool>",  TrieMixMatcher<TriePoolStorage>) \
+	X("mix-alloc",  "TrieMix<Alloc>", TrieMixMatcher<TrieAllocStorage>) \
+	X("trie-louds", "Trie<Louds>",    TrieMatcher<TrieLoudsStorage>) \
+	X("mix-louds",  "TrieMix<Louds>", TrieMixMatcher<TrieLoudsStorage>) \
+	X("trie-da",    "Trie<DA>",       TrieMatcher<TrieDoubleArrayStorage>) \
+	X("mix-da",     "TrieMix<DA>",    TrieMixMatcher<TrieDoubleArrayStorage>) \
+	X("trie-sparse", "Trie<Sparse>",  TrieMatcher<TrieSparseStorage>) \
+	X("mix-sparse", "TrieMix<Sparse>", TrieMixMatcher<TrieSparseStorage>) \
+	X("bifm",       "BiFm",           BiFmMatcher) \
+	X("radix",      "Radix",          RadixMatcher) \
+	X("burst-16",   "Burst<16>",      BurstMatcher<16>) \
+	X("burst",      "Burst<64>",      BurstMatcher<64>) \
+	X("burst-256",  "Burst<256>",     BurstMatcher<256>) \
+	X("shard-trie-pool", "Sharded<Trie<Pool>>", \
+	  ShardedMatcher<TrieMatcher<TriePoolStorage>>) \
+	X("shard-vec-range", "Sharded<VectorRange>", \
+	  ShardedMatcher<VectorRangeMatcher>) \
+	X("numa-trie-pool", "Numa<Trie<Pool>>", \
+	  NumaMatcher<TrieMatcher<TriePoolStorage>>) \
+	X("numa-vec-range", "Numa<VectorRange>", \
+	  NumaMatcher<VectorRangeMatcher>) \
+	X("cache-trie-pool", "Cached<Trie<Pool>>", \
+	  CachedMatcher<TrieMatcher<TriePoolStorage>>) \
+	X("cache-vec-range", "Cached<VectorRange>", \
+	  CachedMatcher<VectorRangeMatcher>) \
+	X("filter-trie-pool", "Filtered<Trie<Pool>>", \
+	  FilteredMatcher<TrieMatcher<TriePoolStorage>>) \
+	X("filter-vec-range", "Filtered<VectorRange>", \
+	  FilteredMatcher<VectorRangeMatcher>) \
+	X("par-trie-pool", "Parallel<Trie<Pool>>", \
+	  ParallelMatcher<TrieMatcher<TriePoolStorage>>) \
+	X("par-vec-range", "Parallel<VectorRange>", \
+	  ParallelMatcher<VectorRangeMatcher>) \
+	X("reload-trie-pool", "Reload<Trie<Pool>>", \
+	  IndexHandle<TrieMatcher<TriePoolStorage>>) \
+	X("reload-vec-range", "Reload<VectorRange>", \
+	  IndexHandle<VectorRangeMatcher>) \
+	X("vec-fixed", "Fixed<Vector>", \
+	  FixedLengthMatcher<BasicVectorMatcher>) \
+	X("trie-pool-fixed", "Fixed<Trie<Pool>>", \
+	  FixedLengthMatcher<TriePoolMatcher>) \
+	X("mix-pool-fixed", "Fixed<TrieMix<Pool>>", \
+	  FixedLengthMatcher<TrieMixPoolMatcher>)
+
+
+#endif
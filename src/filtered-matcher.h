@@ -0,0 +1,161 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_FILTERED_MATCHER_H
+#define H_FILTERED_MATCHER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "bloom-filter.h"
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Wraps Inner matcher with a Bloom filter which lets queries that cannot
+   match return without touching the index.  The filter holds all words,
+   for queries whose prefix and suffix together span the whole word, and
+   (prefix_k, suffix_k) pairs of every word for k in pair_lengths, for
+   queries whose prefix and suffix are both at least k long.  Other
+   queries go straight to the inner matcher. */
+template <class Inner>
+struct FilteredMatcher {
+	static constexpr size_t default_bits_per_key = 10;
+	static constexpr size_t pair_lengths[] = {2, 4};
+
+	FilteredMatcher(const Words &words,
+	                size_t bits_per_key = default_bits_per_key) COLD;
+
+	size_t size() const { return inner.size(); }
+	size_t word_length() const { return inner.word_length(); }
+	size_t memory_usage() const {
+		return sizeof *this - sizeof filter + filter.memory_usage() +
+			inner.memory_usage();
+	}
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const HOT;
+
+	QueryCursor<FilteredMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+private:
+	const Inner inner;
+	BloomFilter filter;
+
+	bool may_match(std::string_view prefix,
+	               std::string_view suffix) const HOT;
+
+	static size_t pair_count(size_t length) {
+		return std::count_if(
+			std::begin(pair_lengths), std::end(pair_lengths),
+			[length](size_t k) { return k <= length; });
+	}
+
+	static uint64_t hash(std::string_view str) {
+		return std::hash<std::string_view>{}(str);
+	}
+
+	static uint64_t pair_hash(std::string_view prefix,
+	                          std::string_view suffix) {
+		const uint64_t hash = FilteredMatcher::hash(prefix);
+		return hash ^ (FilteredMatcher::hash(suffix) +
+		               UINT64_C(0x9e3779b97f4a7c15) +
+		               (hash << 6) + (hash >> 2));
+	}
+
+	FilteredMatcher() = delete;
+	FilteredMatcher(const FilteredMatcher&) = delete;
+};
+
+
+template <class Inner>
+FilteredMatcher<Inner>::FilteredMatcher(const Words &words,
+                                        size_t bits_per_key)
+	: inner(words),
+	  filter(words.size() * (1 + pair_count(words.word_length())),
+	         bits_per_key) {
+	const size_t length = words.word_length();
+	for (const auto &entry : words) {
+		const std::string_view word = entry.first;
+		filter.add(hash(word));
+		for (const size_t k : pair_lengths) {
+			if (k <= length) {
+				filter.add(pair_hash(word.substr(0, k),
+				                     word.substr(length - k)));
+			}
+		}
+	}
+}
+
+
+template <class Inner>
+template <class Callback, class Stats>
+size_t FilteredMatcher<Inner>::query(std::string_view prefix,
+                                     std::string_view suffix,
+                                     Callback &cb, size_t limit,
+                                     Stats &&stats) const {
+	if (!may_match(prefix, suffix)) {
+		return 0;
+	}
+	return inner.query(prefix, suffix, cb, limit, stats);
+}
+
+
+template <class Inner>
+bool FilteredMatcher<Inner>::may_match(std::string_view prefix,
+                                       std::string_view suffix) const {
+	const size_t length = prefix.size() + suffix.size();
+	if (length == word_length()) {
+		if (suffix.empty() || prefix.empty()) {
+			return filter.may_contain(hash(suffix.empty()
+			                               ? prefix : suffix));
+		}
+		/* Scratch space is per thread so concurrent queries are
+		   safe. */
+		static thread_local std::string word;
+		word.assign(prefix);
+		word.append(suffix);
+		return filter.may_contain(hash(word));
+	} else if (length > word_length()) {
+		return true;
+	}
+
+	/* Use the longest pair which fits; it is the most selective. */
+	const size_t shorter = std::min(prefix.size(), suffix.size());
+	for (size_t i = std::size(pair_lengths); i--; ) {
+		const size_t k = pair_lengths[i];
+		if (k <= shorter) {
+			return filter.may_contain(pair_hash(
+				prefix.substr(0, k),
+				suffix.substr(suffix.size() - k)));
+		}
+	}
+	return true;
+}
+
+
+#endif
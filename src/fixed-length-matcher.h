@@ -0,0 +1,97 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_FIXED_LENGTH_MATCHER_H
+#define H_FIXED_LENGTH_MATCHER_H
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Picks at run time a matcher specialised for the word length.  Matcher
+   is instantiated for each of Lengths, where the length is a compile-time
+   constant, and for 0 which stands for length known only at run time and
+   is used for words of any other length. */
+template <template <size_t> class Matcher, size_t... Lengths>
+struct LengthDispatcher {
+	LengthDispatcher(const Words &words) COLD : impl(make(words)) {}
+
+	size_t size() const {
+		return std::visit([](const auto &m) { return m.size(); }, impl);
+	}
+	size_t word_length() const {
+		return std::visit([](const auto &m) { return m.word_length(); },
+		                  impl);
+	}
+	size_t memory_usage() const {
+		return sizeof *this - sizeof impl + std::visit(
+			[](const auto &m) { return m.memory_usage(); }, impl);
+	}
+
+	/* Returns word length the matcher was specialised for or zero if it
+	   uses length known at run time. */
+	size_t fixed_length() const {
+		return impl.index() < sizeof...(Lengths)
+			? lengths[impl.index()] : 0;
+	}
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const {
+		return std::visit([&](const auto &m) {
+			return m.query(prefix, suffix, cb, limit, stats);
+		}, impl);
+	}
+
+	QueryCursor<LengthDispatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+private:
+	using Impl = std::variant<Matcher<Lengths>..., Matcher<0>>;
+	static constexpr size_t lengths[] = { Lengths... };
+
+	template <size_t I = 0>
+	static Impl make(const Words &words) {
+		if constexpr (I < sizeof...(Lengths)) {
+			if (words.word_length() != lengths[I]) {
+				return make<I + 1>(words);
+			}
+		}
+		return Impl(std::in_place_index<I>, words);
+	}
+
+	const Impl impl;
+
+	LengthDispatcher() = delete;
+	LengthDispatcher(const LengthDispatcher&) = delete;
+};
+
+/* Specialises Matcher for the most common word lengths. */
+template <template <size_t> class Matcher>
+using FixedLengthMatcher = LengthDispatcher<Matcher, 8, 10, 16>;
+
+
+#endif
@@ -0,0 +1,273 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef H_FRONT_CODED_MAP_H
+#define H_FRONT_CODED_MAP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "query-stats.h"
+#include "result-sink.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Sorted keys and their values like VectorMap but with keys front coded.
+   Keys are grouped in blocks of BlockSize.  First key of each block, its
+   head, is stored as is; every other key is stored as length of prefix
+   it shares with the previous key, as a varint, followed by the rest of
+   it.  Lookups bisect over the heads and then decode a single block.
+
+   key() decodes into per-thread scratch space which remembers the last
+   decoded key so walking keys in order costs one step each.  Pointer it
+   returns is valid until the next key() or lookup on the same thread. */
+template <size_t BlockSize = 32>
+struct FrontCodedMap {
+	static_assert(BlockSize > 1);
+
+	FrontCodedMap(const Words &words)
+		: FrontCodedMap(words.word_length(), words) {}
+	FrontCodedMap(size_t length, const Words::Map &words) COLD;
+
+	template <class Fn, class Stats = NoStats>
+	void for_each_pair(std::string_view prefix, const Fn &fn,
+	                   Stats &&stats = {}) const {
+		auto [i, last] = range(prefix, stats);
+		Scratch &s = scratch();
+		for (; i < last; ++i) {
+			const char *const key = seek(s, i);
+			if (!fn(std::string_view(key, length), values[i])) {
+				break;
+			}
+		}
+	}
+
+	template <class Fn, class Stats = NoStats>
+	size_t for_each_value(std::string_view prefix, Fn &&fn,
+	                      size_t limit = SIZE_MAX,
+	                      Stats &&stats = {}) const {
+		auto [first, last] = range(prefix, stats);
+		const size_t count = std::min(last - first, limit);
+		push_span(fn, values.data() + first, count);
+		return count;
+	}
+
+	template <class Stats = NoStats>
+	std::pair<size_t, size_t> range(std::string_view prefix,
+	                                Stats &&stats = {}) const {
+		if (prefix.empty()) {
+			return {0, size()};
+		}
+		const auto cmp = [prefix](const char *key) {
+			return std::string_view(key, prefix.size())
+				.compare(prefix);
+		};
+		const size_t lo = partition(0, size(), [&](const char *key) {
+			return cmp(key) < 0;
+		}, stats);
+		return {lo, partition(lo, size(), [&](const char *key) {
+			return cmp(key) <= 0;
+		}, stats)};
+	}
+
+	/* See BasicVectorMap::narrow. */
+	template <class Stats = NoStats>
+	std::pair<size_t, size_t> narrow(size_t lo, size_t hi,
+	                                 size_t depth, char ch,
+	                                 Stats &&stats = {}) const {
+		lo = partition(lo, hi, [depth, ch](const char *key) {
+			return key[depth] < ch;
+		}, stats);
+		return {lo, partition(lo, hi, [depth, ch](const char *key) {
+			return key[depth] <= ch;
+		}, stats)};
+	}
+
+	size_t size() const { return values.size(); }
+	size_t key_length() const { return length; }
+	size_t memory_usage() const {
+		return heads.capacity() + data.capacity() +
+			offsets.capacity() * sizeof offsets[0] +
+			values.capacity() * sizeof values[0];
+	}
+
+	const char *key(size_t idx) const { return seek(scratch(), idx); }
+	uint32_t value(size_t idx) const { return values[idx]; }
+	const uint32_t *value_ptr(size_t idx) const {
+		return values.data() + idx;
+	}
+
+private:
+	/* Decoding position.  One per thread shared by all maps.  Maps are
+	   told apart by id rather than address since a new map may be
+	   allocated where a freed one used to live. */
+	struct Scratch {
+		uint64_t map = 0;
+		size_t idx = 0, pos = 0;
+		std::string key;
+	};
+
+	static Scratch &scratch() {
+		static thread_local Scratch ret;
+		return ret;
+	}
+
+	/* Decodes key following the one in s. */
+	void step(Scratch &s) const;
+	/* Decodes key at given index into s and returns it. */
+	const char *seek(Scratch &s, size_t idx) const HOT;
+
+	/* Returns first index in [lo, hi) whose key is not before, or hi if
+	   there is none.  before must be true for a prefix of the range. */
+	template <class Before, class Stats>
+	size_t partition(size_t lo, size_t hi, const Before &before,
+	                 Stats &stats) const HOT;
+
+	const char *head(size_t block) const {
+		return heads.data() + block * length;
+	}
+
+	static uint64_t next_id() {
+		static std::atomic<uint64_t> next{1};
+		return next++;
+	}
+
+	const uint64_t id = next_id();
+	const size_t length;
+	std::string heads;
+	std::string data;
+	/* Offset in data of the encoded keys following each head. */
+	std::vector<size_t> offsets;
+	std::vector<uint32_t> values;
+
+	FrontCodedMap(const FrontCodedMap&) = delete;
+};
+
+
+template <size_t BlockSize>
+FrontCodedMap<BlockSize>::FrontCodedMap(size_t length,
+                                        const Words::Map &words)
+	: length(length) {
+	values.reserve(words.size());
+	offsets.reserve((words.size() + BlockSize - 1) / BlockSize);
+	std::string_view prev;
+	for (const auto &[key, value] : words) {
+		if (values.size() % BlockSize == 0) {
+			heads.append(key, 0, length);
+			offsets.push_back(data.size());
+		} else {
+			size_t shared = 0;
+			while (shared < length && key[shared] == prev[shared]) {
+				++shared;
+			}
+			for (size_t v = shared; ; v >>= 7) {
+				data.push_back((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+				if (v <= 0x7f) {
+					break;
+				}
+			}
+			data.append(key, shared, length - shared);
+		}
+		values.push_back(value);
+		prev = key;
+	}
+	data.shrink_to_fit();
+}
+
+
+template <size_t BlockSize>
+void FrontCodedMap<BlockSize>::step(Scratch &s) const {
+	++s.idx;
+	if (s.idx % BlockSize == 0) {
+		s.key.assign(head(s.idx / BlockSize), length);
+		s.pos = offsets[s.idx / BlockSize];
+		return;
+	}
+	/* Work on locals; stores through char pointers may alias members. */
+	const char *const base = data.data();
+	const char *ptr = base + s.pos;
+	size_t shared = 0;
+	for (unsigned shift = 0; ; shift += 7) {
+		const unsigned char byte = *ptr++;
+		shared |= size_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			break;
+		}
+	}
+	const size_t tail = length - shared;
+	std::memcpy(s.key.data() + shared, ptr, tail);
+	s.pos = ptr + tail - base;
+}
+
+
+template <size_t BlockSize>
+const char *FrontCodedMap<BlockSize>::seek(Scratch &s, size_t idx) const {
+	if (s.map != id || idx < s.idx ||
+	    idx / BlockSize != s.idx / BlockSize) {
+		s.map = id;
+		s.idx = idx / BlockSize * BlockSize;
+		s.key.assign(head(idx / BlockSize), length);
+		s.pos = offsets[idx / BlockSize];
+	}
+	while (s.idx < idx) {
+		step(s);
+	}
+	return s.key.data();
+}
+
+
+template <size_t BlockSize>
+template <class Before, class Stats>
+size_t FrontCodedMap<BlockSize>::partition(size_t lo, size_t hi,
+                                           const Before &before,
+                                           Stats &stats) const {
+	/* Bisect over heads within the range first. */
+	const size_t first = (lo + BlockSize - 1) / BlockSize;
+	const size_t last = (hi + BlockSize - 1) / BlockSize;
+	size_t b = first, e = last;
+	while (b < e) {
+		const size_t mid = b + (e - b) / 2;
+		stats.compare();
+		if (before(head(mid))) {
+			b = mid + 1;
+		} else {
+			e = mid;
+		}
+	}
+
+	/* Boundary lies after the last head which is before and no later
+	   than the first one which isn't. */
+	size_t idx = b > first ? (b - 1) * BlockSize : lo;
+	const size_t end = b < last ? b * BlockSize : hi;
+	Scratch &s = scratch();
+	for (; idx < end; ++idx) {
+		stats.compare();
+		if (!before(seek(s, idx))) {
+			break;
+		}
+	}
+	return idx;
+}
+
+
+#endif
@@ -0,0 +1,165 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef H_INDEX_HANDLE_H
+#define H_INDEX_HANDLE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Matcher whose index can be replaced while it is being queried.
+   reload() builds a new Inner in a background thread and publishes it
+   with an atomic pointer swap so queries never wait for a build.
+
+   The old index is freed once no query can be using it, which is tracked
+   with epochs.  A query counts itself in a per-thread slot under the
+   parity of the epoch it started in.  After the swap the epoch is
+   advanced and readers counted under the previous parity are waited
+   out, twice, so that a query which read the epoch just before one
+   advance but registered after it is drained as well. */
+template <class Inner>
+struct IndexHandle {
+	IndexHandle(const Words &words)
+		: current(new Inner(words)) {}
+	~IndexHandle() {
+		wait();
+		delete current.load();
+	}
+
+	size_t size() const {
+		return read([](const Inner &inner) { return inner.size(); });
+	}
+	size_t word_length() const {
+		return read([](const Inner &inner) {
+			return inner.word_length();
+		});
+	}
+	size_t memory_usage() const {
+		return sizeof *this + read([](const Inner &inner) {
+			return inner.memory_usage();
+		});
+	}
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const {
+		return read([&](const Inner &inner) {
+			return inner.query(prefix, suffix, cb, limit, stats);
+		});
+	}
+
+	QueryCursor<IndexHandle> cursor() const {
+		return QueryCursor(*this);
+	}
+
+	/* Starts building index of words in a background thread and returns
+	   without waiting for it.  The new index replaces the current one
+	   once built.  A reload already in progress is finished first. */
+	void reload(Words words) COLD;
+
+	/* Waits for a reload in progress to finish. */
+	void wait() {
+		const std::lock_guard lock(mutex);
+		if (builder.joinable()) {
+			builder.join();
+		}
+	}
+
+	/* Number of indices published so far, the initial one included. */
+	size_t generation() const { return generations.load(); }
+
+private:
+	static constexpr size_t slot_count = 64;
+
+	struct alignas(64) Slot {
+		std::atomic<size_t> readers[2] = {};
+	};
+
+	/* Slots are shared by threads whose index collides, which is fine
+	   since they hold counts. */
+	static size_t thread_slot() {
+		static std::atomic<size_t> next;
+		thread_local const size_t slot = next++ % slot_count;
+		return slot;
+	}
+
+	template <class Fn>
+	auto read(const Fn &fn) const {
+		Slot &slot = slots[thread_slot()];
+		const size_t parity = epoch.load() & 1;
+		++slot.readers[parity];
+		const auto ret = fn(*current.load());
+		--slot.readers[parity];
+		return ret;
+	}
+
+	void publish(Inner *next) COLD;
+
+	std::atomic<Inner *> current;
+	std::atomic<uint64_t> epoch = 0;
+	std::atomic<size_t> generations = 1;
+	mutable std::array<Slot, slot_count> slots;
+
+	/* Guards builder. */
+	std::mutex mutex;
+	std::thread builder;
+
+	IndexHandle() = delete;
+	IndexHandle(const IndexHandle&) = delete;
+};
+
+
+template <class Inner>
+void IndexHandle<Inner>::reload(Words words) {
+	const std::lock_guard lock(mutex);
+	if (builder.joinable()) {
+		builder.join();
+	}
+	builder = std::thread([this, words = std::move(words)] {
+		publish(new Inner(words));
+	});
+}
+
+
+template <class Inner>
+void IndexHandle<Inner>::publish(Inner *next) {
+	const Inner *const old = current.exchange(next);
+	++generations;
+	for (int i = 0; i < 2; ++i) {
+		const size_t parity = epoch++ & 1;
+		for (const Slot &slot : slots) {
+			while (slot.readers[parity].load()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+	delete old;
+}
+
+
+#endif
@@ -0,0 +1,88 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_NUMA_MATCHER_H
+#define H_NUMA_MATCHER_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "numa.h"
+#include "query-stats.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Builds a separate replica of Inner matcher on every NUMA node, each on
+   a thread bound to the node so all its memory is node-local.  Queries go
+   to the replica of the node the calling thread runs on. */
+template <class Inner>
+struct NumaMatcher {
+	NumaMatcher(const Words &words) COLD;
+
+	size_t size() const { return replicas[0]->size(); }
+	size_t word_length() const { return replicas[0]->word_length(); }
+	size_t memory_usage() const {
+		size_t ret = sizeof *this;
+		for (const auto &replica : replicas) {
+			ret += replica->memory_usage();
+		}
+		return ret;
+	}
+	size_t replica_count() const { return replicas.size(); }
+
+	const Inner &local() const HOT {
+		return *replicas[replicas.size() == 1
+			? 0 : NumaTopology::get().current()];
+	}
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const {
+		return local().query(prefix, suffix, cb, limit, stats);
+	}
+
+	auto cursor() const { return local().cursor(); }
+
+private:
+	std::vector<std::unique_ptr<const Inner>> replicas;
+
+	NumaMatcher() = delete;
+	NumaMatcher(const NumaMatcher&) = delete;
+};
+
+
+template <class Inner>
+NumaMatcher<Inner>::NumaMatcher(const Words &words) {
+	const NumaTopology &topology = NumaTopology::get();
+	replicas.resize(topology.size());
+	if (topology.size() == 1) {
+		replicas[0] = std::make_unique<const Inner>(words);
+		return;
+	}
+	for (size_t node = 0; node < topology.size(); ++node) {
+		topology.run_on(node, true, [&] {
+			replicas[node] = std::make_unique<const Inner>(words);
+		});
+	}
+}
+
+
+#endif
@@ -0,0 +1,145 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_NUMA_H
+#define H_NUMA_H
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "util.h"
+
+
+/* Minimal NUMA support using raw syscalls and sysfs so there is no
+   dependency on libnuma. */
+struct NumaTopology {
+	/* Returns topology of the running system.  On systems without NUMA
+	   (or without sysfs) reports a single node with all CPUs. */
+	static const NumaTopology &get() {
+		static const NumaTopology topology;
+		return topology;
+	}
+
+	size_t size() const { return nodes.size(); }
+	const std::vector<int> &cpus(size_t node) const {
+		return nodes[node].second;
+	}
+	int id(size_t node) const { return nodes[node].first; }
+
+	/* Returns index of the node the calling thread is running on. */
+	size_t current() const HOT {
+		const int cpu = sched_getcpu();
+		return cpu >= 0 && size_t(cpu) < node_of_cpu.size()
+			? node_of_cpu[cpu] : 0;
+	}
+
+	/* Runs fn on a new thread pinned to CPUs of given node and waits for
+	   it to finish.  If bind_memory is true, all memory the thread
+	   allocates is bound to the node. */
+	template <class Fn>
+	void run_on(size_t node, bool bind_memory, const Fn &fn) const COLD;
+
+private:
+	NumaTopology() COLD;
+
+	std::vector<std::pair<int, std::vector<int>>> nodes;
+	std::vector<size_t> node_of_cpu;
+};
+
+
+inline NumaTopology::NumaTopology() {
+	for (int id = 0; id < 1024; ++id) {
+		const std::string path = "/sys/devices/system/node/node" +
+			std::to_string(id) + "/cpulist";
+		FILE *const fd = fopen(path.c_str(), "r");
+		if (!fd) {
+			continue;
+		}
+		std::vector<int> cpus;
+		int lo, hi;
+		char sep;
+		while (fscanf(fd, "%d", &lo) == 1) {
+			hi = lo;
+			if (fscanf(fd, "%c", &sep) == 1 && sep == '-') {
+				if (fscanf(fd, "%d", &hi) != 1) {
+					break;
+				}
+				fscanf(fd, "%c", &sep);
+			}
+			for (; lo <= hi; ++lo) {
+				cpus.push_back(lo);
+			}
+		}
+		fclose(fd);
+		if (!cpus.empty()) {
+			nodes.emplace_back(id, std::move(cpus));
+		}
+	}
+
+	if (nodes.empty()) {
+		std::vector<int> cpus;
+		const unsigned n = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned cpu = 0; cpu < n; ++cpu) {
+			cpus.push_back(cpu);
+		}
+		nodes.emplace_back(0, std::move(cpus));
+	}
+
+	for (size_t node = 0; node < nodes.size(); ++node) {
+		for (const int cpu : nodes[node].second) {
+			if (node_of_cpu.size() <= size_t(cpu)) {
+				node_of_cpu.resize(cpu + 1);
+			}
+			node_of_cpu[cpu] = node;
+		}
+	}
+}
+
+
+template <class Fn>
+void NumaTopology::run_on(size_t node, bool bind_memory, const Fn &fn) const {
+	std::thread thread([this, node, bind_memory, &fn]{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (const int cpu : cpus(node)) {
+			CPU_SET(cpu, &set);
+		}
+		pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+
+		/* Memory policy is per thread so it goes away with it. */
+		const int id = this->id(node);
+		std::vector<unsigned long> mask(id / (8 * sizeof(long)) + 1);
+		mask[id / (8 * sizeof(long))] |= 1ul << (id % (8 * sizeof(long)));
+		if (bind_memory && syscall(SYS_set_mempolicy, MPOL_BIND,
+		                           mask.data(), mask.size() * 8 *
+		                           sizeof(long) + 1)) {
+			perror("set_mempolicy");
+		}
+		fn();
+	});
+	thread.join();
+}
+
+
+#endif
@@ -0,0 +1,140 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef H_PARALLEL_MATCHER_H
+#define H_PARALLEL_MATCHER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "result-sink.h"
+#include "thread-pool.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Wraps Inner matcher so that queries expected to report many words are
+   split into chunks run on a thread pool.  Inner estimates the size of
+   a query and reports chunk i of n with query_chunk.  Queries estimated
+   below threshold run on the calling thread as they are.  Otherwise
+   workers claim chunks one at a time, which balances uneven subtrees,
+   collecting results into per-chunk buffers which are then passed to the
+   callback on calling thread in chunk order. */
+template <class Inner>
+struct ParallelMatcher {
+	static constexpr size_t default_threshold = 4096;
+
+	ParallelMatcher(const Words &words,
+	                size_t threshold = default_threshold,
+	                unsigned threads = default_threads())
+		: inner(words), threshold(threshold),
+		  pool(std::max(1u, threads) - 1) {}
+
+	size_t size() const { return inner.size(); }
+	size_t word_length() const { return inner.word_length(); }
+	size_t memory_usage() const {
+		return sizeof *this + inner.memory_usage();
+	}
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const HOT;
+
+	QueryCursor<ParallelMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+	static unsigned default_threads() {
+		return std::thread::hardware_concurrency();
+	}
+
+private:
+	/* Chunks per thread.  More than one so a thread done with a small
+	   chunk can pick up another while others work on big ones. */
+	static constexpr size_t chunks_per_thread = 4;
+
+	/* Counts work done by a chunk but not words it reports; some of
+	   those may be dropped when merging so query counts them after. */
+	template <class Stats>
+	struct ChunkStats : Stats {
+		void emit(size_t = 1) {}
+	};
+
+	const Inner inner;
+	const size_t threshold;
+	mutable ThreadPool pool;
+
+	ParallelMatcher() = delete;
+	ParallelMatcher(const ParallelMatcher&) = delete;
+};
+
+
+template <class Inner>
+template <class Callback, class Stats>
+size_t ParallelMatcher<Inner>::query(std::string_view prefix,
+                                     std::string_view suffix,
+                                     Callback &cb, size_t limit,
+                                     Stats &&stats) const {
+	if (!pool.size() || !limit ||
+	    prefix.size() + suffix.size() > word_length() ||
+	    inner.estimate(prefix, suffix) < threshold) {
+		return inner.query(prefix, suffix, cb, limit, stats);
+	}
+
+	/* Chunks run concurrently so each counts into its own stats. */
+	using Chunk = ChunkStats<std::remove_reference_t<Stats>>;
+	size_t chunks = (pool.size() + 1) * chunks_per_thread;
+	if constexpr (requires { Inner::max_chunks; }) {
+		chunks = std::min(chunks, Inner::max_chunks);
+	}
+	static thread_local std::vector<std::vector<uint32_t>> scratch;
+	static thread_local std::vector<Chunk> scratch_stats;
+	auto &results = scratch;
+	auto &chunk_stats = scratch_stats;
+	results.resize(chunks);
+	chunk_stats.assign(chunks, Chunk());
+	pool.parallel_for(chunks, [&](size_t i) {
+		std::vector<uint32_t> &out = results[i];
+		const auto collect = [&out](uint32_t id) { out.push_back(id); };
+		out.clear();
+		inner.query_chunk(prefix, suffix, i, chunks, collect, limit,
+		                  chunk_stats[i]);
+	});
+	for (const Chunk &s : chunk_stats) {
+		stats += s;
+	}
+
+	/* Each chunk stopped at limit on its own; trim the merged result
+	   to keep chunk order. */
+	size_t cnt = 0;
+	for (const std::vector<uint32_t> &out : results) {
+		const size_t n = std::min(out.size(), limit - cnt);
+		push_span(cb, out.data(), n);
+		cnt += n;
+	}
+	stats.emit(cnt);
+	return cnt;
+}
+
+
+#endif
@@ -0,0 +1,255 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* pmatch-load — load generator for pmatchd.  Opens a number of
+   connections, each served by its own thread, keeps up to a given number
+   of pipelined requests in flight on each and reports throughput and
+   latency percentiles. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+	const char *socket_path = nullptr;
+	unsigned connections = 1;
+	size_t depth = 16;
+	size_t requests = 100'000;
+	size_t plen = 1, slen = 1;
+	uint32_t limit = UINT32_MAX;
+};
+
+struct Stats {
+	std::vector<double> latencies_us;
+	size_t errors = 0;
+	size_t results = 0;
+	bool ok = true;
+};
+
+
+static int connect_to(const char *path) {
+	struct sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+	                      sizeof addr)) {
+		perror(path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+
+static bool write_all(int fd, const char *data, size_t size) {
+	while (size) {
+		const ssize_t n = write(fd, data, size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			perror("write");
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+
+static void run_conn(const Options &opts, unsigned seed, Stats &stats) {
+	const int fd = connect_to(opts.socket_path);
+	if (fd < 0) {
+		stats.ok = false;
+		return;
+	}
+
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<char> distrib('a', 'z');
+	std::vector<Clock::time_point> sent_at(opts.requests);
+	stats.latencies_us.reserve(opts.requests);
+
+	std::vector<char> out, in;
+	size_t sent = 0, received = 0;
+	while (received < opts.requests) {
+		out.clear();
+		for (; sent < opts.requests && sent - received < opts.depth;
+		     ++sent) {
+			const RequestHeader req = {
+				static_cast<uint32_t>(sent),
+				static_cast<uint32_t>(opts.plen),
+				static_cast<uint32_t>(opts.slen),
+				opts.limit,
+			};
+			const char *const hdr =
+				reinterpret_cast<const char *>(&req);
+			out.insert(out.end(), hdr, hdr + sizeof req);
+			for (size_t i = opts.plen + opts.slen; i; --i) {
+				out.push_back(distrib(gen));
+			}
+			sent_at[sent] = Clock::now();
+		}
+		if (!out.empty() && !write_all(fd, out.data(), out.size())) {
+			stats.ok = false;
+			break;
+		}
+
+		char buf[65536];
+		const ssize_t n = read(fd, buf, sizeof buf);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			fputs(n ? "read failed\n" : "connection closed\n",
+			      stderr);
+			stats.ok = false;
+			break;
+		}
+		const auto now = Clock::now();
+		in.insert(in.end(), buf, buf + n);
+
+		size_t pos = 0;
+		ResponseHeader resp;
+		while (in.size() - pos >= sizeof resp) {
+			std::memcpy(&resp, in.data() + pos, sizeof resp);
+			const size_t len = sizeof resp +
+				resp.returned * sizeof(uint32_t);
+			if (in.size() - pos < len) {
+				break;
+			}
+			pos += len;
+			if (resp.id >= opts.requests) {
+				fputs("unexpected response id\n", stderr);
+				stats.ok = false;
+				received = opts.requests;
+				break;
+			}
+			stats.latencies_us.push_back(
+				std::chrono::duration<double, std::micro>(
+					now - sent_at[resp.id]).count());
+			stats.errors += resp.status != STATUS_OK;
+			stats.results += resp.returned;
+			++received;
+		}
+		in.erase(in.begin(), in.begin() + pos);
+	}
+	close(fd);
+}
+
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s --socket <path> [<option>...]\n"
+	        "  --connections <n>    number of connections (default: 1)\n"
+	        "  --depth <n>          requests in flight per connection\n"
+	        "  --requests <n>       requests per connection\n"
+	        "  --plen <n>           length of random prefixes\n"
+	        "  --slen <n>           length of random suffixes\n"
+	        "  --limit <n>          maximum number of ids per response\n",
+	        argv0);
+}
+
+
+int main(int argc, char **argv) {
+	Options opts;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const std::string_view opt = argv[i];
+		const char *const arg = argv[i + 1];
+		const size_t value = strtod(arg, nullptr);
+		if (opt == "--socket") {
+			opts.socket_path = arg;
+		} else if (opt == "--connections") {
+			opts.connections = value;
+		} else if (opt == "--depth") {
+			opts.depth = value;
+		} else if (opt == "--requests") {
+			opts.requests = value;
+		} else if (opt == "--plen") {
+			opts.plen = value;
+		} else if (opt == "--slen") {
+			opts.slen = value;
+		} else if (opt == "--limit") {
+			opts.limit = std::min<size_t>(value, UINT32_MAX);
+		} else {
+			opts.socket_path = nullptr;
+			break;
+		}
+	}
+	if (!opts.socket_path || !opts.connections || !opts.depth ||
+	    !opts.requests || opts.requests > UINT32_MAX || argc % 2 != 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	std::vector<Stats> stats(opts.connections);
+	std::vector<std::thread> threads;
+	const auto start = Clock::now();
+	for (unsigned i = 0; i < opts.connections; ++i) {
+		threads.emplace_back(run_conn, std::cref(opts), i,
+		                     std::ref(stats[i]));
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	const double secs = std::chrono::duration<double>(
+		Clock::now() - start).count();
+
+	std::vector<double> latencies;
+	size_t errors = 0, results = 0;
+	bool ok = true;
+	for (const Stats &st : stats) {
+		latencies.insert(latencies.end(), st.latencies_us.begin(),
+		                 st.latencies_us.end());
+		errors += st.errors;
+		results += st.results;
+		ok = ok && st.ok;
+	}
+	if (latencies.empty()) {
+		return 1;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	const auto percentile = [&latencies](double p) {
+		return latencies[std::min<size_t>(
+			latencies.size() - 1, latencies.size() * p / 100)];
+	};
+
+	printf("requests  %zu (%zu errors, %zu results)\n",
+	       latencies.size(), errors, results);
+	printf("qps       %.0f\n", latencies.size() / secs);
+	printf("latency   p50 %.1f µs  p90 %.1f µs  p99 %.1f µs  "
+	       "p99.9 %.1f µs  max %.1f µs\n",
+	       percentile(50), percentile(90), percentile(99),
+	       percentile(99.9), latencies.back());
+	return !ok;
+}
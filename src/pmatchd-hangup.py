@@ -0,0 +1,80 @@
+import os
+import random
+import signal
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+# Smoke test of pmatchd: clients hang up right after sending a small
+# batch, so the server often sees them go while a worker still holds
+# their requests and in the same epoll_wait as the worker finishing.
+# Afterwards the server must still answer queries and exit cleanly.
+# Best run against a build with -fsanitize=address.
+# Usage: python3 pmatchd-hangup.py <path to pmatchd>
+
+ROUNDS = 1000
+CONNECTIONS = 16
+BATCH = 10
+
+
+def request(id, prefix=b'', suffix=b'', limit=1000):
+        return struct.pack('=IIII', id, len(prefix), len(suffix),
+                           limit) + prefix + suffix
+
+
+def connect(path):
+        sock = socket.socket(socket.AF_UNIX)
+        sock.connect(path)
+        return sock
+
+
+def recv_exact(sock, size):
+        data = b''
+        while len(data) < size:
+                chunk = sock.recv(size - len(data))
+                if not chunk:
+                        raise EOFError('server closed connection')
+                data += chunk
+        return data
+
+
+with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'pmatch.sock')
+        server = subprocess.Popen([sys.argv[1], '--socket', path,
+                                   '--count', '100000', '--len', '8',
+                                   '--workers', '2'],
+                                  stderr=subprocess.DEVNULL)
+        while not os.path.exists(path):
+                if server.poll() is not None:
+                        sys.exit('pmatchd exited early')
+                time.sleep(0.1)
+
+        batch = b''.join(request(i) for i in range(BATCH))
+        try:
+                for _ in range(ROUNDS):
+                        socks = [connect(path) for _ in range(CONNECTIONS)]
+                        for sock in socks:
+                                sock.sendall(batch)
+                        for sock in socks:
+                                time.sleep(random.random() * 0.0005)
+                                sock.close()
+
+                sock = connect(path)
+                sock.sendall(request(42, limit=5))
+                id, status, count, returned = struct.unpack(
+                        '=IIII', recv_exact(sock, 16))
+                recv_exact(sock, returned * 4)
+                sock.close()
+                ok = id == 42 and status == 0 and count == returned == 5
+        except (OSError, EOFError) as e:
+                print('pmatchd hangup test:', e)
+                ok = False
+
+        if server.poll() is None:
+                server.send_signal(signal.SIGTERM)
+        ok = server.wait(timeout=30) == 0 and ok
+        print('pmatchd hangup test:', 'PASS' if ok else 'FAIL')
+        sys.exit(not ok)
@@ -0,0 +1,596 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* pmatchd — serves prefix/suffix queries against a single index over
+   a Unix domain socket.  See protocol.h for the wire format.
+
+   The main thread multiplexes connections with epoll.  Complete
+   requests read from a connection are handed as one batch to a fixed
+   pool of worker threads which write responses, ids included, directly
+   into the connection's output buffer; the main thread then sends it.
+   At most one batch per connection is in flight at a time so responses
+   come in request order. */
+
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "any-matcher.h"
+#include "protocol.h"
+
+
+struct Conn {
+	explicit Conn(int fd) : fd(fd) {}
+
+	const int fd;
+	/* Bytes read but not yet handed to a worker. */
+	std::vector<char> in;
+	/* Requests being handled by a worker. */
+	std::vector<char> batch;
+	/* Responses; out_pos is offset in bytes of data not yet sent. */
+	std::vector<uint32_t> out;
+	size_t out_pos = 0;
+	uint32_t events = EPOLLIN | EPOLLRDHUP;
+	bool busy = false;
+	bool eof = false;
+	bool closing = false;
+	/* Closed but not yet freed; see Server::close_conn. */
+	bool dead = false;
+
+	bool flushed() const {
+		return out_pos == out.size() * sizeof(uint32_t);
+	}
+	/* Whether to read more requests.  Reading stops while the largest
+	   allowed request could already be buffered and resumes once
+	   a worker takes requests from the buffer. */
+	bool reading() const {
+		return !eof && !closing && in.size() < max_request_size;
+	}
+	/* Whether the connection failed or peer closed it and all its
+	   requests have been answered. */
+	bool finished() const {
+		return closing || (eof && !busy && flushed());
+	}
+};
+
+
+struct WorkQueue {
+	void push(Conn *conn) {
+		{
+			std::lock_guard lock(mutex);
+			queue.push_back(conn);
+		}
+		cond.notify_one();
+	}
+
+	/* Used by workers; blocks until there is a connection to handle or
+	   the queue is stopped. */
+	Conn *pop() {
+		std::unique_lock lock(mutex);
+		cond.wait(lock, [this]{ return stopped || !queue.empty(); });
+		if (queue.empty()) {
+			return nullptr;
+		}
+		Conn *const conn = queue.front();
+		queue.pop_front();
+		return conn;
+	}
+
+	/* Used by the main thread; takes all queued connections. */
+	std::deque<Conn *> take() {
+		std::lock_guard lock(mutex);
+		return std::move(queue);
+	}
+
+	void stop() {
+		{
+			std::lock_guard lock(mutex);
+			stopped = true;
+		}
+		cond.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<Conn *> queue;
+	bool stopped = false;
+};
+
+
+static bool valid_affix(std::string_view str) {
+	return std::all_of(str.begin(), str.end(), [](char ch) {
+		return 'a' <= ch && ch <= 'z';
+	});
+}
+
+
+/* Handles all requests in conn->batch appending responses to conn->out. */
+static void handle_batch(const AnyMatcher &matcher, Conn *conn) HOT;
+static void handle_batch(const AnyMatcher &matcher, Conn *conn) {
+	const char *ptr = conn->batch.data();
+	const char *const end = ptr + conn->batch.size();
+	std::vector<uint32_t> &out = conn->out;
+	while (ptr < end) {
+		RequestHeader req;
+		std::memcpy(&req, ptr, sizeof req);
+		ptr += sizeof req;
+		const std::string_view prefix(ptr, req.prefix_len);
+		ptr += req.prefix_len;
+		const std::string_view suffix(ptr, req.suffix_len);
+		ptr += req.suffix_len;
+
+		const size_t pos = out.size();
+		out.resize(pos + sizeof(ResponseHeader) / sizeof(uint32_t));
+		ResponseHeader resp = { req.id, STATUS_INVALID, 0, 0 };
+		if (prefix.size() + suffix.size() <= matcher.word_length() &&
+		    valid_affix(prefix) && valid_affix(suffix)) {
+			resp.status = STATUS_OK;
+			resp.count = matcher.query(prefix, suffix, out,
+			                           req.limit);
+			resp.returned = out.size() - pos -
+				sizeof resp / sizeof(uint32_t);
+		}
+		std::memcpy(out.data() + pos, &resp, sizeof resp);
+	}
+	conn->batch.clear();
+}
+
+
+struct Server {
+	Server(const AnyMatcher &matcher, int listen_fd)
+		: matcher(matcher), listen_fd(listen_fd) {}
+
+	bool run(unsigned workers) COLD;
+
+private:
+	enum : uint64_t { LISTEN, DONE, SIGNAL };
+
+	void accept_conns() COLD;
+	void read_conn(Conn *conn);
+	void flush_conn(Conn *conn);
+	void dispatch_conn(Conn *conn);
+	void close_conn(Conn *conn) COLD;
+	void free_conns() COLD;
+	void update_events(Conn *conn);
+	void watch(int fd, uint64_t data, uint32_t events,
+	           int op = EPOLL_CTL_ADD);
+
+	void work();
+
+	const AnyMatcher &matcher;
+	const int listen_fd;
+	int epoll_fd = -1;
+	int done_fd = -1;
+	WorkQueue pending, done;
+	std::vector<Conn *> dead;
+};
+
+
+void Server::watch(int fd, uint64_t data, uint32_t events, int op) {
+	struct epoll_event ev = {};
+	ev.events = events;
+	ev.data.u64 = data;
+	if (epoll_ctl(epoll_fd, op, fd, &ev)) {
+		perror("epoll_ctl");
+	}
+}
+
+
+void Server::accept_conns() {
+	for (;;) {
+		const int fd = accept4(listen_fd, nullptr, nullptr,
+		                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EINTR) {
+				perror("accept");
+			}
+			return;
+		}
+		Conn *const conn = new Conn(fd);
+		watch(fd, reinterpret_cast<uintptr_t>(conn),
+		      EPOLLIN | EPOLLRDHUP);
+	}
+}
+
+
+void Server::read_conn(Conn *conn) {
+	char buf[65536];
+	while (conn->reading()) {
+		const ssize_t n = read(conn->fd, buf, sizeof buf);
+		if (n > 0) {
+			conn->in.insert(conn->in.end(), buf, buf + n);
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else {
+			if (n == 0) {
+				conn->eof = true;
+			} else if (errno != EAGAIN) {
+				conn->closing = true;
+			}
+			break;
+		}
+	}
+	dispatch_conn(conn);
+	update_events(conn);
+}
+
+
+/* Moves all complete requests from conn->in to conn->batch and queues
+   the connection for a worker unless one is already handling it or there
+   are unsent responses. */
+void Server::dispatch_conn(Conn *conn) {
+	if (conn->busy || conn->closing || !conn->flushed()) {
+		return;
+	}
+	conn->out.clear();
+	conn->out_pos = 0;
+
+	size_t pos = 0;
+	RequestHeader req;
+	while (conn->in.size() - pos >= sizeof req) {
+		std::memcpy(&req, conn->in.data() + pos, sizeof req);
+		const uint64_t len = sizeof req + uint64_t(req.prefix_len) +
+			req.suffix_len;
+		if (len > max_request_size) {
+			conn->closing = true;
+			return;
+		} else if (conn->in.size() - pos < len) {
+			break;
+		}
+		pos += len;
+	}
+
+	if (pos) {
+		conn->batch.assign(conn->in.begin(), conn->in.begin() + pos);
+		conn->in.erase(conn->in.begin(), conn->in.begin() + pos);
+		conn->busy = true;
+		pending.push(conn);
+	}
+}
+
+
+void Server::flush_conn(Conn *conn) {
+	const char *const data = reinterpret_cast<const char *>(
+		conn->out.data());
+	const size_t size = conn->out.size() * sizeof(uint32_t);
+	while (conn->out_pos < size) {
+		const ssize_t n = write(conn->fd, data + conn->out_pos,
+		                        size - conn->out_pos);
+		if (n > 0) {
+			conn->out_pos += n;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else {
+			if (errno != EAGAIN) {
+				conn->closing = true;
+			}
+			break;
+		}
+	}
+
+	if (conn->flushed()) {
+		dispatch_conn(conn);
+	}
+	update_events(conn);
+}
+
+
+void Server::update_events(Conn *conn) {
+	/* While busy the output buffer belongs to the worker. */
+	uint32_t events = 0;
+	if (!conn->busy && !conn->flushed()) {
+		events |= EPOLLOUT;
+	}
+	if (conn->reading()) {
+		events |= EPOLLIN | EPOLLRDHUP;
+	}
+	if (events != conn->events && !conn->closing) {
+		conn->events = events;
+		watch(conn->fd, reinterpret_cast<uintptr_t>(conn), events,
+		      EPOLL_CTL_MOD);
+	}
+}
+
+
+/* Closes the connection but doesn't free it yet.  Events already
+   returned by epoll_wait may still refer to it; they are skipped and it
+   is freed by free_conns once they are all handled. */
+void Server::close_conn(Conn *conn) {
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+	close(conn->fd);
+	conn->dead = true;
+	dead.push_back(conn);
+}
+
+
+void Server::free_conns() {
+	for (Conn *const conn : dead) {
+		delete conn;
+	}
+	dead.clear();
+}
+
+
+void Server::work() {
+	while (Conn *const conn = pending.pop()) {
+		handle_batch(matcher, conn);
+		done.push(conn);
+		const uint64_t one = 1;
+		if (write(done_fd, &one, sizeof one) < 0) {
+			perror("eventfd");
+		}
+	}
+}
+
+
+bool Server::run(unsigned workers) {
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	const int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (signal_fd < 0 || epoll_fd < 0 || done_fd < 0) {
+		perror("pmatchd");
+		return false;
+	}
+	watch(listen_fd, LISTEN, EPOLLIN);
+	watch(done_fd, DONE, EPOLLIN);
+	watch(signal_fd, SIGNAL, EPOLLIN);
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < workers; ++i) {
+		threads.emplace_back(&Server::work, this);
+	}
+
+	struct epoll_event events[64];
+	for (bool running = true; running;) {
+		const int n = epoll_wait(epoll_fd, events, 64, -1);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			break;
+		}
+		for (int i = 0; i < n; ++i) {
+			switch (const uint64_t data = events[i].data.u64) {
+			case LISTEN:
+				accept_conns();
+				break;
+			case SIGNAL:
+				running = false;
+				break;
+			case DONE: {
+				uint64_t count;
+				if (read(done_fd, &count, sizeof count) < 0) {
+					break;
+				}
+				for (Conn *const conn : done.take()) {
+					conn->busy = false;
+					flush_conn(conn);
+					if (conn->finished() && !conn->busy) {
+						close_conn(conn);
+					}
+				}
+				break;
+			}
+			default: {
+				Conn *const conn = reinterpret_cast<Conn *>(data);
+				const uint32_t ev = events[i].events;
+				if (conn->dead) {
+					break;
+				}
+				if (ev & (EPOLLHUP | EPOLLERR)) {
+					/* There's no one left to answer.  HUP is
+					   reported whatever the mask so while
+					   a worker owns the connection it is
+					   taken out of epoll altogether. */
+					conn->closing = true;
+					if (conn->busy) {
+						epoll_ctl(epoll_fd, EPOLL_CTL_DEL,
+						          conn->fd, nullptr);
+					}
+				}
+				if (ev & EPOLLOUT && !conn->busy) {
+					flush_conn(conn);
+				}
+				if (ev & (EPOLLIN | EPOLLRDHUP) && conn->reading()) {
+					read_conn(conn);
+				}
+				if (conn->finished() && !conn->busy) {
+					close_conn(conn);
+				}
+			}
+			}
+		}
+		free_conns();
+	}
+
+	pending.stop();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	close(signal_fd);
+	close(done_fd);
+	close(epoll_fd);
+	return true;
+}
+
+
+static bool load_words(const char *path, std::string &data, size_t &count,
+                       size_t &length) COLD;
+static bool load_words(const char *path, std::string &data, size_t &count,
+                       size_t &length) {
+	FILE *const fd = fopen(path, "r");
+	if (!fd) {
+		perror(path);
+		return false;
+	}
+	char *line = nullptr;
+	size_t capacity = 0;
+	ssize_t len;
+	bool ok = true;
+	for (count = 0; ok && (len = getline(&line, &capacity, fd)) > 0;) {
+		if (line[len - 1] == '\n') {
+			--len;
+		}
+		const std::string_view word(line, len);
+		if (!count) {
+			length = len;
+		}
+		ok = len && size_t(len) == length && valid_affix(word);
+		data.append(word);
+		++count;
+	}
+	if (!ok) {
+		fprintf(stderr, "%s:%zu: words must be non-empty, of equal "
+		        "length and consist of letters a-z\n", path, count);
+	}
+	free(line);
+	fclose(fd);
+	return ok && count;
+}
+
+
+static int listen_on(const char *path) COLD;
+static int listen_on(const char *path) {
+	struct sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "%s: socket path too long\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+	                      SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr)
+	    || listen(fd, SOMAXCONN)) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "usage: %s --socket <path> [<option>...]\n"
+	        "  --engine <id>        engine to use (default: vec-range)\n"
+	        "  --words <file>       file with one word per line\n"
+	        "  --count <n>          number of random words (default: 1e6)\n"
+	        "  --len <n>            length of random words (default: 10)\n"
+	        "  --workers <n>        number of worker threads\n",
+	        argv0);
+}
+
+
+int main(int argc, char **argv) {
+	const char *socket_path = nullptr, *words_path = nullptr;
+	const char *engine = "vec-range";
+	size_t count = 1'000'000, length = 10;
+	unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const std::string_view opt = argv[i];
+		const char *const arg = argv[i + 1];
+		if (opt == "--socket") {
+			socket_path = arg;
+		} else if (opt == "--engine") {
+			engine = arg;
+		} else if (opt == "--words") {
+			words_path = arg;
+		} else if (opt == "--count") {
+			count = strtod(arg, nullptr);
+		} else if (opt == "--len") {
+			length = strtod(arg, nullptr);
+		} else if (opt == "--workers") {
+			workers = strtoul(arg, nullptr, 10);
+		} else {
+			socket_path = nullptr;
+			break;
+		}
+	}
+	if (!socket_path || !workers || !count || !length ||
+	    argc % 2 != 1) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	std::string data;
+	if (words_path) {
+		if (!load_words(words_path, data, count, length)) {
+			return 1;
+		}
+	} else {
+		data.resize(count * length);
+		std::mt19937_64 gen(42);
+		std::uniform_int_distribution<char> distrib('a', 'z');
+		for (char &ch : data) {
+			ch = distrib(gen);
+		}
+	}
+
+	std::unique_ptr<AnyMatcher> matcher;
+	{
+		const Words words(data.data(), count, length);
+		matcher = AnyMatcher::make(engine, words);
+	}
+	if (!matcher) {
+		fprintf(stderr, "%s: unknown engine\n", engine);
+		return 2;
+	}
+	std::string().swap(data);
+	fprintf(stderr, "%s: %zu×%zu words, %zu bytes\n", engine,
+	        matcher->size(), matcher->word_length(),
+	        matcher->memory_usage());
+
+	const int listen_fd = listen_on(socket_path);
+	if (listen_fd < 0) {
+		return 1;
+	}
+	const bool ok = Server(*matcher, listen_fd).run(workers);
+	close(listen_fd);
+	unlink(socket_path);
+	return !ok;
+}
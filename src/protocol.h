@@ -0,0 +1,62 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_PROTOCOL_H
+#define H_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+/* Wire protocol spoken by pmatchd over a Unix domain socket.  All
+   integers are in host byte order.
+
+   A request is a RequestHeader followed by prefix_len bytes of prefix
+   and suffix_len bytes of suffix.  A response is a ResponseHeader
+   followed by `returned` 32-bit word ids; `count` is the number of
+   matching words found which, since the search stops once limit ids
+   have been found, is always equal to `returned`.  Requests may be
+   pipelined; responses on a connection come in the order requests were
+   sent. */
+
+struct RequestHeader {
+	uint32_t id;
+	uint32_t prefix_len;
+	uint32_t suffix_len;
+	uint32_t limit;
+};
+
+struct ResponseHeader {
+	uint32_t id;
+	uint32_t status;
+	uint32_t count;
+	uint32_t returned;
+};
+
+enum : uint32_t {
+	STATUS_OK      = 0,
+	STATUS_INVALID = 1,
+};
+
+/* Requests larger than this are a protocol violation and cause the
+   server to drop the connection. */
+static constexpr size_t max_request_size = 16 << 20;
+
+static_assert(sizeof(RequestHeader) == 16);
+static_assert(sizeof(ResponseHeader) == 16);
+
+
+#endif
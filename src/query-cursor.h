@@ -0,0 +1,51 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_QUERY_CURSOR_H
+#define H_QUERY_CURSOR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "util.h"
+
+
+/* Typeahead cursor for matchers which have no way of reusing work done
+   for a shorter prefix.  Accumulates the prefix and runs a regular
+   query. */
+template <class Matcher>
+struct QueryCursor {
+	explicit QueryCursor(const Matcher &matcher) : matcher(matcher) {}
+
+	void extend_prefix(char ch) { prefix.push_back(ch); }
+	void set_suffix(std::string_view sfx) { suffix.assign(sfx); }
+
+	template <class Callback>
+	size_t query(Callback &cb, size_t limit = SIZE_MAX) const {
+		if (prefix.size() + suffix.size() > matcher.word_length()) {
+			return 0;
+		}
+		return matcher.query(prefix, suffix, cb, limit);
+	}
+
+private:
+	const Matcher &matcher;
+	std::string prefix, suffix;
+};
+
+
+#endif
@@ -0,0 +1,71 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef H_QUERY_STATS_H
+#define H_QUERY_STATS_H
+
+#include <cstddef>
+
+
+/* Work done by queries.  Every matcher's query() takes an optional stats
+   argument which it updates as it goes:
+
+     followed  -- trie or tree nodes followed along the pattern and
+                  backward search steps,
+     fanned    -- nodes or entries reached by fanning out under the
+                  unknown middle of the word,
+     compared  -- keys compared while bisecting sorted keys or scanning
+                  a bucket,
+     filtered  -- candidates which matched one side of the pattern but
+                  were rejected by the other,
+     results   -- ids passed to the callback by the engine itself.
+
+   The default NoStats does nothing so queries which don't ask for
+   counters compile to the same code as before. */
+struct QueryStats {
+	size_t followed = 0;
+	size_t fanned = 0;
+	size_t compared = 0;
+	size_t filtered = 0;
+	size_t results = 0;
+
+	void follow(size_t n = 1) { followed += n; }
+	void fan(size_t n = 1) { fanned += n; }
+	void compare(size_t n = 1) { compared += n; }
+	void filter(size_t n = 1) { filtered += n; }
+	void emit(size_t n = 1) { results += n; }
+
+	QueryStats &operator+=(const QueryStats &rhs) {
+		followed += rhs.followed;
+		fanned += rhs.fanned;
+		compared += rhs.compared;
+		filtered += rhs.filtered;
+		results += rhs.results;
+		return *this;
+	}
+};
+
+struct NoStats {
+	void follow(size_t = 1) {}
+	void fan(size_t = 1) {}
+	void compare(size_t = 1) {}
+	void filter(size_t = 1) {}
+	void emit(size_t = 1) {}
+
+	NoStats &operator+=(const NoStats &) { return *this; }
+};
+
+
+#endif
@@ -0,0 +1,223 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef H_RADIX_MATCHER_H
+#define H_RADIX_MATCHER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "util.h"
+#include "vector-map.h"
+#include "words.h"
+
+
+/* Patricia trie over sorted keys of a VectorMap.  Unary chains are
+   collapsed so there are at most two nodes per key no matter how long
+   the keys are.  A node covers range of keys sharing their first depth
+   characters; edge labels aren't stored but read from the first key of
+   the range so following an edge is a single memcmp. */
+struct RadixTree {
+	explicit RadixTree(const VectorMap &keys) COLD;
+
+	/* Returns [lo, hi) range of keys starting with prefix. */
+	template <class Stats = NoStats>
+	std::pair<size_t, size_t> range(std::string_view prefix,
+	                                Stats &&stats = {}) const HOT;
+
+	size_t memory_usage() const {
+		return nodes.capacity() * sizeof(Node);
+	}
+
+private:
+	struct Node {
+		uint32_t lo, hi;
+		/* Length of the path from the root up to and including edge
+		   leading to this node. */
+		uint32_t depth;
+		/* Children are stored next to each other sorted by ch. */
+		uint32_t first_child;
+		uint16_t children;
+		/* First character of the edge leading to this node. */
+		unsigned char ch;
+	};
+
+	/* Returns length of common prefix of keys a and b knowing it is at
+	   least from. */
+	size_t common(size_t a, size_t b, size_t from) const {
+		const size_t length = keys.key_length();
+		const char *const x = keys.key(a), *const y = keys.key(b);
+		while (from < length && x[from] == y[from]) {
+			++from;
+		}
+		return from;
+	}
+
+	const VectorMap &keys;
+	std::vector<Node> nodes;
+
+	RadixTree(const RadixTree&) = delete;
+};
+
+
+inline RadixTree::RadixTree(const VectorMap &keys) : keys(keys) {
+	const size_t count = keys.size();
+	nodes.push_back({0, uint32_t(count),
+	                 uint32_t(count ? common(0, count - 1, 0) : 0),
+	                 0, 0, 0});
+	/* Nodes are expanded breadth first so that children of each node
+	   end up next to each other. */
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const Node node = nodes[i];
+		if (node.depth == keys.key_length()) {
+			continue;
+		}
+		nodes[i].first_child = nodes.size();
+		for (size_t lo = node.lo; lo < node.hi; ) {
+			const char ch = keys.key(lo)[node.depth];
+			const size_t hi =
+				keys.narrow(lo, node.hi, node.depth, ch).second;
+			nodes.push_back({uint32_t(lo), uint32_t(hi),
+			                 uint32_t(common(lo, hi - 1,
+			                                 node.depth + 1)),
+			                 0, 0, (unsigned char)ch});
+			++nodes[i].children;
+			lo = hi;
+		}
+	}
+	nodes.shrink_to_fit();
+}
+
+
+template <class Stats>
+std::pair<size_t, size_t>
+RadixTree::range(std::string_view prefix, Stats &&stats) const {
+	const Node *node = nodes.data();
+	size_t pos = 0;
+	while (node->lo < node->hi) {
+		stats.follow();
+		const size_t end = std::min<size_t>(node->depth, prefix.size());
+		if (std::memcmp(keys.key(node->lo) + pos, prefix.data() + pos,
+		                end - pos)) {
+			break;
+		}
+		if (end == prefix.size()) {
+			return {node->lo, node->hi};
+		}
+		pos = end;
+
+		const unsigned char ch = prefix[pos];
+		const Node *child = nodes.data() + node->first_child;
+		const Node *const last = child + node->children;
+		while (child < last && child->ch < ch) {
+			++child;
+		}
+		stats.fan(child - (nodes.data() + node->first_child));
+		if (child == last || child->ch != ch) {
+			break;
+		}
+		node = child;
+	}
+	return {0, 0};
+}
+
+
+/* Pair of Patricia tries, one over the words and one over reversed
+   words.  Longer of the prefix and suffix selects range of words in one
+   of the tries and the other is checked with memcmp against each word in
+   that range so a query never walks a chain of single-child nodes. */
+struct RadixMatcher {
+	RadixMatcher(const Words &words) COLD
+		: fwd(words), rev(make_reversed(fwd)),
+		  fwd_tree(fwd), rev_tree(rev) {}
+
+	size_t size() const { return fwd.size(); }
+	size_t word_length() const { return fwd.key_length(); }
+	size_t memory_usage() const {
+		return sizeof *this + fwd.memory_usage() + rev.memory_usage() +
+			fwd_tree.memory_usage() + rev_tree.memory_usage();
+	}
+	template <class Callback, class Stats = NoStats>
+	inline size_t query(std::string_view prefix,
+	                    std::string_view suffix,
+	                    Callback &cb,
+	                    size_t limit = SIZE_MAX,
+	                    Stats &&stats = {}) const HOT;
+
+	QueryCursor<RadixMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+private:
+	const VectorMap fwd, rev;
+	const RadixTree fwd_tree, rev_tree;
+
+	RadixMatcher() = delete;
+	RadixMatcher(const RadixMatcher&) = delete;
+};
+
+
+template <class Callback, class Stats>
+size_t RadixMatcher::query(std::string_view prefix,
+                           std::string_view suffix,
+                           Callback &cb, size_t limit,
+                           Stats &&stats) const {
+	const size_t length = word_length();
+	if (prefix.size() + suffix.size() > length) {
+		return 0;
+	}
+
+	size_t cnt = 0;
+	if (prefix.size() >= suffix.size()) {
+		auto [i, last] = fwd_tree.range(prefix, stats);
+		const size_t offset = length - suffix.size();
+		for (; i < last && cnt < limit; ++i) {
+			stats.compare();
+			if (!std::memcmp(fwd.key(i) + offset,
+			                 suffix.data(), suffix.size())) {
+				cb(fwd.value(i));
+				++cnt;
+			} else {
+				stats.filter();
+			}
+		}
+	} else {
+		const std::string reversed(suffix.rbegin(), suffix.rend());
+		auto [i, last] = rev_tree.range(reversed, stats);
+		for (; i < last && cnt < limit; ++i) {
+			const uint32_t v = rev.value(i);
+			stats.compare();
+			if (!std::memcmp(fwd.key(v),
+			                 prefix.data(), prefix.size())) {
+				cb(fwd.value(v));
+				++cnt;
+			} else {
+				stats.filter();
+			}
+		}
+	}
+	stats.emit(cnt);
+	return cnt;
+}
+
+
+#endif
@@ -0,0 +1,173 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+#ifndef H_RESULT_SINK_H
+#define H_RESULT_SINK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "util.h"
+
+
+/* Matchers report ids through a callback, cb(id), or a sink.  A sink
+   takes single ids with push(id) and runs of ids with push_span(ids, n)
+   so engines which find results in contiguous runs hand them over
+   without a call per id.  Sinks are callable as well so they can be
+   given to any matcher. */
+template <class Out>
+concept ResultSink = requires (Out &out, const uint32_t *ids) {
+	out.push(uint32_t());
+	out.push_span(ids, size_t());
+};
+
+
+/* Writes ids into caller's buffer of fixed capacity.  Ids past the
+   capacity are dropped so query limit should not exceed it. */
+struct ArraySink {
+	ArraySink(uint32_t *out, size_t capacity)
+		: out(out), capacity(capacity) {}
+
+	void push(uint32_t id) {
+		if (count < capacity) {
+			out[count++] = id;
+		}
+	}
+	void push_span(const uint32_t *ids, size_t n) {
+		n = std::min(n, capacity - count);
+		std::memcpy(out + count, ids, n * sizeof *ids);
+		count += n;
+	}
+	void operator()(uint32_t id) { push(id); }
+
+	size_t size() const { return count; }
+
+private:
+	uint32_t *const out;
+	const size_t capacity;
+	size_t count = 0;
+};
+
+
+/* Appends ids to a vector. */
+struct VectorSink {
+	explicit VectorSink(std::vector<uint32_t> &out) : out(out) {}
+
+	void push(uint32_t id) { out.push_back(id); }
+	void push_span(const uint32_t *ids, size_t n) {
+		out.insert(out.end(), ids, ids + n);
+	}
+	void operator()(uint32_t id) { push(id); }
+
+private:
+	std::vector<uint32_t> &out;
+};
+
+
+/* Collects ids in a local buffer of Capacity and passes them to Out in
+   runs once it fills up and when flushed or destroyed.  Lets loops which
+   find ids one at a time, such as trie fan-out, make one call per run
+   rather than per id. */
+template <class Out, size_t Capacity = 256>
+struct BufferedSink {
+	explicit BufferedSink(Out &out) : out(out) {}
+	~BufferedSink() { flush(); }
+
+	void push(uint32_t id) {
+		buffer[count++] = id;
+		if (count == Capacity) {
+			flush();
+		}
+	}
+	void push_span(const uint32_t *ids, size_t n) {
+		flush();
+		out.push_span(ids, n);
+	}
+	void operator()(uint32_t id) { push(id); }
+
+	void flush() {
+		if (count) {
+			out.push_span(buffer, count);
+			count = 0;
+		}
+	}
+
+private:
+	Out &out;
+	size_t count = 0;
+	uint32_t buffer[Capacity];
+
+	BufferedSink(const BufferedSink&) = delete;
+};
+
+
+/* Passes n ids to out, in one run if it is a sink. */
+template <class Out>
+inline void push_span(Out &out, const uint32_t *ids, size_t n) {
+	if constexpr (ResultSink<Out>) {
+		out.push_span(ids, n);
+	} else {
+		for (const uint32_t *const end = ids + n; ids < end; ++ids) {
+			out(*ids);
+		}
+	}
+}
+
+
+/* Passes map(v) to out for values v in [it, end) for which keep(v) holds,
+   stopping after limit.  Advances it past the values examined and
+   returns number of ids passed.  For a sink, kept values are compacted
+   into a local buffer without branching on keep, mapped and passed on
+   in runs. */
+template <class Out, class Keep, class Map>
+size_t push_if(Out &out, const uint32_t *&it, const uint32_t *end,
+               size_t limit, const Keep &keep, const Map &map) HOT;
+
+template <class Out, class Keep, class Map>
+size_t push_if(Out &out, const uint32_t *&it, const uint32_t *end,
+               size_t limit, const Keep &keep, const Map &map) {
+	size_t cnt = 0;
+	if constexpr (ResultSink<Out>) {
+		constexpr size_t capacity = 256;
+		uint32_t buffer[capacity];
+		while (it < end && cnt < limit) {
+			const size_t room = std::min(capacity, limit - cnt);
+			size_t n = 0;
+			for (; it < end && n < room; ++it) {
+				buffer[n] = *it;
+				n += keep(*it);
+			}
+			/* Map only kept values; it may cost a cache miss. */
+			for (size_t i = 0; i < n; ++i) {
+				buffer[i] = map(buffer[i]);
+			}
+			out.push_span(buffer, n);
+			cnt += n;
+		}
+	} else {
+		for (; it < end && cnt < limit; ++it) {
+			if (keep(*it)) {
+				out(map(*it));
+				++cnt;
+			}
+		}
+	}
+	return cnt;
+}
+
+
+#endif
@@ -0,0 +1,167 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_SHARDED_MATCHER_H
+#define H_SHARDED_MATCHER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "thread-pool.h"
+#include "query-cursor.h"
+#include "query-stats.h"
+#include "result-sink.h"
+#include "util.h"
+#include "words.h"
+
+
+/* Partitions words into shards by ranges of their first letter and builds
+   separate Inner matcher for each in parallel.  Queries whose first
+   letter is known go to a single shard; others fan out to all shards on
+   a thread pool with results passed to the callback on calling thread in
+   shard order. */
+template <class Inner>
+struct ShardedMatcher {
+	ShardedMatcher(const Words &words)
+		: ShardedMatcher(words, default_shards()) {}
+	ShardedMatcher(const Words &words, size_t shards) COLD;
+
+	size_t size() const { return count; }
+	size_t word_length() const { return length; }
+	size_t shard_count() const { return shards.size(); }
+	size_t memory_usage() const {
+		size_t ret = sizeof *this +
+			shards.capacity() * sizeof shards[0];
+		for (const auto &shard : shards) {
+			ret += shard->memory_usage();
+		}
+		return ret;
+	}
+
+	template <class Callback, class Stats = NoStats>
+	size_t query(std::string_view prefix,
+	             std::string_view suffix,
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const HOT;
+
+	QueryCursor<ShardedMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
+
+	static size_t default_shards() {
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+private:
+	const size_t count;
+	const size_t length;
+	std::array<uint8_t, 26> shard_of;
+	std::vector<std::unique_ptr<const Inner>> shards;
+	mutable ThreadPool pool;
+
+	ShardedMatcher() = delete;
+	ShardedMatcher(const ShardedMatcher&) = delete;
+};
+
+
+template <class Inner>
+ShardedMatcher<Inner>::ShardedMatcher(const Words &words, size_t n)
+	: count(words.size()), length(words.word_length()),
+	  pool(std::clamp<size_t>(n, 1, default_shards()) - 1) {
+	/* Split the alphabet into at most n ranges with roughly equal
+	   number of words.  Empty words can only go to one shard. */
+	std::array<size_t, 26> per_letter = {};
+	for (const auto &pair : words) {
+		if (!pair.first.empty()) {
+			++per_letter[pair.first[0] - 'a'];
+		}
+	}
+	n = length ? std::clamp<size_t>(n, 1, 26) : 1;
+
+	std::vector<std::pair<char, char>> ranges;
+	size_t seen = 0;
+	for (size_t ch = 0; ch < 26; ++ch) {
+		if (ranges.empty() ||
+		    (ranges.size() < n &&
+		     seen >= count * ranges.size() / n)) {
+			ranges.emplace_back('a' + ch, 'a' + ch);
+		}
+		ranges.back().second = 'a' + ch;
+		shard_of[ch] = ranges.size() - 1;
+		seen += per_letter[ch];
+	}
+
+	shards.resize(ranges.size());
+	pool.parallel_for(ranges.size(), [&](size_t i) {
+		shards[i] = std::make_unique<const Inner>(
+			ranges.size() == 1 ? words : words.subset(
+				ranges[i].first, ranges[i].second));
+	});
+}
+
+
+template <class Inner>
+template <class Callback, class Stats>
+size_t ShardedMatcher<Inner>::query(std::string_view prefix,
+                                    std::string_view suffix,
+                                    Callback &cb, size_t limit,
+                                    Stats &&stats) const {
+	if (!prefix.empty() || (length && suffix.size() == length)) {
+		const char first = prefix.empty() ? suffix[0] : prefix[0];
+		return shards[shard_of[first - 'a']]->query(prefix, suffix, cb,
+		                                            limit, stats);
+	} else if (shards.size() == 1 || !limit) {
+		return shards[0]->query(prefix, suffix, cb, limit, stats);
+	}
+
+	/* Shards run concurrently so each counts into its own stats. */
+	using ShardStats = std::remove_reference_t<Stats>;
+	static thread_local std::vector<std::vector<uint32_t>> scratch;
+	static thread_local std::vector<ShardStats> scratch_stats;
+	auto &results = scratch;
+	auto &shard_stats = scratch_stats;
+	results.resize(shards.size());
+	shard_stats.assign(shards.size(), ShardStats());
+	pool.parallel_for(shards.size(), [&](size_t i) {
+		std::vector<uint32_t> &out = results[i];
+		const auto collect = [&out](uint32_t id) { out.push_back(id); };
+		out.clear();
+		shards[i]->query(prefix, suffix, collect, limit,
+		                 shard_stats[i]);
+	});
+	for (const ShardStats &s : shard_stats) {
+		stats += s;
+	}
+
+	/* Each shard stopped at limit on its own; trim the merged result
+	   to keep shard order. */
+	size_t cnt = 0;
+	for (const std::vector<uint32_t> &out : results) {
+		const size_t n = std::min(out.size(), limit - cnt);
+		push_span(cb, out.data(), n);
+		cnt += n;
+	}
+	return cnt;
+}
+
+
+#endif
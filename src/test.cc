@@ -15,16 +15,34 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <utility>
 #include <random>
+#include <string>
+#include <thread>
 
+#include "bifm-matcher.h"
 #include "bitmap-matcher.h"
+#include "burst-matcher.h"
+#include "cached-matcher.h"
+#include "filtered-matcher.h"
+#include "fixed-length-matcher.h"
+#include "index-handle.h"
+#include "numa-matcher.h"
+#include "parallel-matcher.h"
+#include "query-stats.h"
+#include "radix-matcher.h"
+#include "result-sink.h"
+#include "sharded-matcher.h"
+#include "trie-double-array.h"
+#include "trie-louds.h"
 #include "trie-matcher.h"
 #include "trie-mix-matcher.h"
+#include "trie-sparse.h"
 #include "vector-matcher.h"
 #include "vector-range-matcher.h"
 
@@ -69,8 +87,27 @@ static bool check(const Matcher &matcher,
 	const size_t got_count = matcher.query(prefix, suffix, cb);
 	std::sort(got.begin(), got.end());
 
+	/* Counting work must not change the result. */
+	QueryStats stats;
+	size_t counted = 0;
+	const auto count = [&counted](uint32_t) { ++counted; };
+	matcher.query(prefix, suffix, count, SIZE_MAX, stats);
+
+	/* Sinks must get the same ids as callbacks, and a buffer sink no
+	   more than it can hold. */
+	std::vector<uint32_t> sunk;
+	VectorSink sink(sunk);
+	const size_t sunk_count = matcher.query(prefix, suffix, sink);
+	std::sort(sunk.begin(), sunk.end());
+	uint32_t first[2];
+	ArraySink array(first, 2);
+	matcher.query(prefix, suffix, array, 2);
+
 	const bool ok = got_count == want.size() &&
-		!memcmp(want.begin(), got.data(), want.size() * sizeof got[0]);
+		!memcmp(want.begin(), got.data(), want.size() * sizeof got[0]) &&
+		counted == got_count && stats.results == got_count &&
+		sunk == got && sunk_count == got_count &&
+		array.size() == std::min<size_t>(got_count, 2);
 	print_result(ok, prefix, suffix, matcher.word_length());
 	if (!ok) {
 		print_array("want", want.begin(), want.size());
@@ -159,6 +196,61 @@ static const char *random_buffer() {
 	return buffer.data();
 }
 
+using TestQuery = std::pair<std::string_view, std::string_view>;
+
+/* Returns queries tests compare matchers with: for i-th of 100 words of
+   given length taken from random_buffer(), its first i % 3 and last
+   i / 3 % 3 characters. */
+static std::vector<TestQuery> test_queries(size_t length) {
+	std::vector<TestQuery> ret;
+	for (size_t i = 0; i < 100; ++i) {
+		const std::string_view word(random_buffer() + i, length);
+		ret.emplace_back(word.substr(0, i % 3),
+		                 word.substr(length - i / 3 % 3));
+	}
+	return ret;
+}
+
+/* Returns words matcher reports for a query, in the order it reports
+   them. */
+template <class Matcher>
+static std::vector<uint32_t> results(const Matcher &matcher,
+                                     const TestQuery &query) {
+	std::vector<uint32_t> ret;
+	const auto cb = [&ret](uint32_t v) { ret.push_back(v); };
+	matcher.query(query.first, query.second, cb);
+	return ret;
+}
+
+/* Returns whether for each of test_queries() matcher reports the same
+   words as reference and counts them correctly, both in what it returns
+   and in its stats.  With a limit reference results are cut to it since
+   a limited query reports the first words of an unlimited one.  Unless
+   ordered, which only makes sense without a limit, results are compared
+   as sets. */
+template <class Reference, class Matcher>
+static bool same_results(const Reference &reference, const Matcher &matcher,
+                         size_t limit = SIZE_MAX, bool ordered = true) {
+	bool same = true;
+	std::vector<uint32_t> got;
+	const auto cb = [&got](uint32_t v) { got.push_back(v); };
+	for (const TestQuery &query : test_queries(matcher.word_length())) {
+		std::vector<uint32_t> want = results(reference, query);
+		want.resize(std::min(want.size(), limit));
+		got.clear();
+		QueryStats stats;
+		const size_t cnt = matcher.query(query.first, query.second,
+		                                 cb, limit, stats);
+		if (!ordered) {
+			std::sort(want.begin(), want.end());
+			std::sort(got.begin(), got.end());
+		}
+		same = same && want == got && cnt == got.size() &&
+			stats.results == cnt;
+	}
+	return same;
+}
+
 template <class Matcher>
 static bool run_huge_tests(const char *name) {
 	const Words words(random_buffer(), 10, 1'000'000);
@@ -179,12 +271,371 @@ static bool run_huge_tests(const char *name) {
 	return true;
 }
 
+template <class Matcher>
+static bool run_concurrent_tests(const char *name) {
+	const Words words(random_buffer(), 2000, 4);
+	print_header(name, words.size(), words.word_length());
+	const Matcher matcher(words);
+
+	/* Every thread runs the same queries; all must agree with results
+	   collected on a single thread. */
+	using Results = std::vector<std::vector<uint32_t>>;
+	const auto run = [&matcher](Results &out) {
+		for (const TestQuery &query : test_queries(4)) {
+			out.push_back(results(matcher, query));
+		}
+	};
+
+	Results want;
+	run(want);
+
+	std::vector<Results> got(4);
+	std::vector<std::thread> threads;
+	for (Results &out : got) {
+		threads.emplace_back(run, std::ref(out));
+	}
+	bool ok = true;
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+		ok = ok && got[i] == want;
+	}
+	fprintf(stderr, "  %s <%zu threads>\33[0m\n",
+	        result_message[ok], threads.size());
+	return ok;
+}
+
+template <class Matcher>
+static bool run_limit_tests(const char *name) {
+	const Words words(random_buffer(), 2000, 4);
+	print_header(name, words.size(), words.word_length());
+	const Matcher matcher(words);
+
+	/* A limited query must return the first results of an unlimited
+	   one, in the same order. */
+	bool ok = true;
+	for (const size_t limit : {0, 1, 3}) {
+		const bool same = same_results(matcher, matcher, limit);
+		fprintf(stderr, "  %s <limit %zu>\33[0m\n",
+		        result_message[same], limit);
+		ok = ok && same;
+	}
+	return ok;
+}
+
+
+template <class Matcher>
+static bool run_cursor_tests(const char *name) {
+	const Words words(random_buffer(), 2000, 4);
+	print_header(name, words.size(), words.word_length());
+	const Matcher matcher(words);
+
+	/* Typing a word one character at a time must give the same results
+	   as querying each prefix from scratch. */
+	bool ok = true;
+	std::vector<uint32_t> want, got;
+	const auto want_cb = [&want](uint32_t v) { want.push_back(v); };
+	const auto got_cb = [&got](uint32_t v) { got.push_back(v); };
+	for (size_t i = 0; i < 100; ++i) {
+		const std::string_view word(random_buffer() + i, 4);
+		const std::string suffix(word.substr(4 - i % 3));
+		auto cursor = matcher.cursor();
+		if (i % 2) {
+			cursor.set_suffix(suffix);
+		}
+		for (size_t plen = 0; plen <= 4; ++plen) {
+			if (plen == 1 && i % 2 == 0) {
+				cursor.set_suffix(suffix);
+			}
+			const auto sfx = plen || i % 2 ? suffix : "";
+			want.clear();
+			got.clear();
+			if (plen + sfx.size() <= 4) {
+				matcher.query(word.substr(0, plen), sfx, want_cb);
+			}
+			const size_t cnt = cursor.query(got_cb);
+			std::sort(want.begin(), want.end());
+			std::sort(got.begin(), got.end());
+			ok = ok && want == got && cnt == got.size();
+			ok = ok && cursor.query(got_cb, 1) == std::min<size_t>(
+				want.size(), 1);
+			if (plen < 4) {
+				cursor.extend_prefix(word[plen]);
+			}
+		}
+	}
+	fprintf(stderr, "  %s <cursor>\33[0m\n", result_message[ok]);
+	return ok;
+}
+
+
+template <class Matcher>
+static bool run_approx_tests(const char *name) {
+	const Words words(random_buffer(), 2000, 6);
+	print_header(name, words.size(), words.word_length());
+	const Matcher matcher(words);
+
+	/* Results must be the words whose prefix and suffix differ from the
+	   pattern in at most k characters, as found by brute force. */
+	bool ok = true;
+	std::vector<uint32_t> want, got;
+	const auto got_cb = [&got](uint32_t v) { got.push_back(v); };
+	for (const size_t k : {0, 1, 2}) {
+		bool same = true;
+		for (size_t i = 0; i < 100; ++i) {
+			const std::string_view word(random_buffer() + i * 7, 6);
+			const auto prefix = word.substr(0, i % 4);
+			const auto suffix = word.substr(6 - i / 4 % 4);
+			want.clear();
+			for (const auto &[candidate, id] : words) {
+				size_t diff = 0;
+				for (size_t j = 0; j < prefix.size(); ++j) {
+					diff += candidate[j] != prefix[j];
+				}
+				for (size_t j = 0; j < suffix.size(); ++j) {
+					diff += candidate[6 - suffix.size() + j] !=
+						suffix[j];
+				}
+				if (diff <= k) {
+					want.push_back(id);
+				}
+			}
+			got.clear();
+			const size_t cnt =
+				matcher.query_approx(prefix, suffix, k, got_cb);
+			std::sort(want.begin(), want.end());
+			std::sort(got.begin(), got.end());
+			same = same && want == got && cnt == got.size();
+			same = same && matcher.query_approx(
+				prefix, suffix, k, got_cb, 2) ==
+				std::min<size_t>(want.size(), 2);
+		}
+		fprintf(stderr, "  %s <%zu mismatches>\33[0m\n",
+		        result_message[same], k);
+		ok = ok && same;
+	}
+	return ok;
+}
+
+
+template <class Matcher>
+static bool run_count_tests(const char *name) {
+	/* Half of the words share a long prefix so prefix length is a poor
+	   guide to which side of the query is more selective. */
+	std::string data(random_buffer(), 2000 * 8);
+	for (size_t i = 0; i < 2000; i += 2) {
+		data.replace(i * 8, 5, "aaaaa");
+	}
+	const Words words(data.data(), 2000, 8);
+	print_header(name, words.size(), words.word_length());
+	const Matcher matcher(words);
+
+	/* Counts and queries must agree with brute force. */
+	bool ok = true;
+	std::vector<uint32_t> want, got;
+	const auto got_cb = [&got](uint32_t v) { got.push_back(v); };
+	for (size_t i = 0; i < 200; ++i) {
+		const std::string_view word(data.data() + i / 2 * 8, 8);
+		const auto prefix = word.substr(0, i % 7);
+		const auto suffix = word.substr(8 - i / 7 % 4);
+		if (prefix.size() + suffix.size() > 8) {
+			continue;
+		}
+		want.clear();
+		for (const auto &[candidate, id] : words) {
+			if (std::string_view(candidate).starts_with(prefix) &&
+			    std::string_view(candidate).ends_with(suffix)) {
+				want.push_back(id);
+			}
+		}
+		got.clear();
+		const size_t cnt = matcher.query(prefix, suffix, got_cb);
+		std::sort(want.begin(), want.end());
+		std::sort(got.begin(), got.end());
+		ok = ok && want == got && cnt == got.size() &&
+			matcher.count(prefix, suffix) == want.size();
+	}
+	fprintf(stderr, "  %s <count>\33[0m\n", result_message[ok]);
+	return ok;
+}
+
+
+template <template <size_t> class Matcher>
+static bool run_fixed_tests(const char *name) {
+	bool ok = true;
+	for (const size_t len : {8, 10, 16, 5}) {
+		const Words words(random_buffer(), 2000, len);
+		const FixedLengthMatcher<Matcher> matcher(words);
+		const Matcher<0> dynamic(words);
+		print_header(name, words.size(), words.word_length());
+
+		/* Specialised matcher must give the same results in the same
+		   order as one using run-time length. */
+		const bool same =
+			matcher.fixed_length() == (len == 5 ? 0 : len) &&
+			same_results(dynamic, matcher);
+		fprintf(stderr, "  %s <fixed length %zu>\33[0m\n",
+		        result_message[same], matcher.fixed_length());
+		ok = ok && same;
+	}
+	return ok;
+}
+
+
+template <class Inner>
+static bool run_sharded_tests(const char *name) {
+	const Words words(random_buffer(), 2000, 4);
+	const Inner inner(words);
+
+	bool ok = true;
+	for (const size_t shards : {2, 5, 26, 100}) {
+		const ShardedMatcher<Inner> matcher(words, shards);
+		print_header(name, words.size(), words.word_length());
+
+		/* Shards are gathered in no particular order. */
+		const bool same = same_results(inner, matcher, SIZE_MAX, false);
+		fprintf(stderr, "  %s <%zu shards>\33[0m\n",
+		        result_message[same], matcher.shard_count());
+		ok = ok && same;
+	}
+	return ok;
+}
+
+template <class Inner>
+static bool run_parallel_tests(const char *name) {
+	const Words words(random_buffer(), 2000, 4);
+	const Inner inner(words);
+
+	bool ok = true;
+	for (const unsigned threads : {2, 4}) {
+		/* Threshold of one splits every query which can match. */
+		const ParallelMatcher<Inner> matcher(words, 1, threads);
+		print_header(name, words.size(), words.word_length());
+
+		/* Chunks are merged in order so results, limited or not, must
+		   match the inner matcher's exactly, and only words which
+		   survive the merge may be counted. */
+		bool same = same_results(inner, matcher);
+		for (const size_t limit : {1, 4, 7}) {
+			same = same && same_results(inner, matcher, limit);
+		}
+		fprintf(stderr, "  %s <%u threads>\33[0m\n",
+		        result_message[same], threads);
+		ok = ok && same;
+	}
+	return ok;
+}
+
+
+template <class Inner>
+static bool run_cache_tests(const char *name) {
+	const Words words(random_buffer(), 2000, 4);
+	const Inner inner(words);
+	const size_t budget = 8 << 10;
+	const CachedMatcher<Inner> matcher(words, budget);
+	print_header(name, words.size(), words.word_length());
+
+	/* Repeated queries with varying limits must agree with the inner
+	   matcher while the small budget forces evictions. */
+	bool same = true;
+	for (size_t i = 0; i < 6; ++i) {
+		const size_t limit = i % 2 ? SIZE_MAX : i;
+		same = same_results(inner, matcher, limit) && same;
+	}
+	const CacheStats stats = matcher.stats();
+	same = same && stats.hits && stats.evictions && stats.bytes <= budget;
+	fprintf(stderr, "  %s <hit rate %.2f, %zu entries>\33[0m\n",
+	        result_message[same], stats.hit_rate(), stats.entries);
+
+	/* A complete result must replace an incomplete one of the same
+	   size, which a query limited to exactly the number of matches or
+	   to none leaves, so that repeating the unlimited query hits. */
+	const CachedMatcher<Inner> fresh(words);
+	const auto ignore = [](uint32_t) {};
+	bool replaced = true;
+	const std::vector<TestQuery> queries = test_queries(4);
+	for (size_t i = 0; i < 20; ++i) {
+		const auto &[prefix, suffix] = queries[i];
+		const size_t limit =
+			i % 2 ? results(inner, queries[i]).size() : 0;
+		fresh.query(prefix, suffix, ignore, limit);
+		fresh.query(prefix, suffix, ignore);
+		const uint64_t hits = fresh.stats().hits;
+		fresh.query(prefix, suffix, ignore);
+		replaced = replaced && fresh.stats().hits == hits + 1;
+	}
+	fprintf(stderr, "  %s <complete replaces incomplete>\33[0m\n",
+	        result_message[replaced]);
+	return same && replaced;
+}
+
+template <class Inner>
+static bool run_reload_tests(const char *name) {
+	const Words words[2] = {
+		Words(random_buffer(), 1000, 4),
+		Words(random_buffer() + 4000, 1000, 4),
+	};
+	IndexHandle<Inner> handle(words[0]);
+	print_header(name, words[0].size(), words[0].word_length());
+
+	/* Results of test queries against either set of words, sorted. */
+	using Results = std::vector<std::vector<uint32_t>>;
+	const auto run = [](const auto &matcher, Results &out) {
+		out.clear();
+		for (const TestQuery &query : test_queries(4)) {
+			out.push_back(results(matcher, query));
+			std::sort(out.back().begin(), out.back().end());
+		}
+	};
+	Results want[2];
+	run(Inner(words[0]), want[0]);
+	run(Inner(words[1]), want[1]);
+
+	/* Readers must see one index or the other while it is swapped
+	   underneath them. */
+	std::atomic<bool> done = false, same = true;
+	std::vector<std::thread> readers;
+	for (size_t i = 0; i < 3; ++i) {
+		readers.emplace_back([&] {
+			Results got;
+			while (!done.load()) {
+				run(handle, got);
+				for (size_t j = 0; j < got.size(); ++j) {
+					if (got[j] != want[0][j] &&
+					    got[j] != want[1][j]) {
+						same = false;
+					}
+				}
+			}
+		});
+	}
+	const size_t reloads = 10;
+	for (size_t i = 1; i <= reloads; ++i) {
+		handle.reload(words[i % 2]);
+		handle.wait();
+	}
+	done = true;
+	for (std::thread &reader : readers) {
+		reader.join();
+	}
+
+	Results got;
+	run(handle, got);
+	const bool ok = same && got == want[reloads % 2] &&
+		handle.generation() == reloads + 1;
+	fprintf(stderr, "  %s <%zu reloads, %zu readers>\33[0m\n",
+	        result_message[ok], reloads, readers.size());
+	return ok;
+}
+
 template <class Matcher>
 static bool run_tests(const char *name) {
 	bool ok = true;
 	ok = run_small_tests<Matcher>(name) && ok;
 	ok = run_medium_tests<Matcher>(name) && ok;
 	ok = run_huge_tests<Matcher>(name) && ok;
+	ok = run_concurrent_tests<Matcher>(name) && ok;
+	ok = run_limit_tests<Matcher>(name) && ok;
+	ok = run_cursor_tests<Matcher>(name) && ok;
 	return ok;
 }
 
@@ -198,8 +649,60 @@ int main(void) {
 	RUN_TESTS(TrieMatcher<TriePoolStorage>);
 	RUN_TESTS(TrieMixMatcher<TrieAllocStorage>);
 	RUN_TESTS(TrieMixMatcher<TriePoolStorage>);
+	RUN_TESTS(TrieMatcher<TrieLoudsStorage>);
+	RUN_TESTS(TrieMixMatcher<TrieLoudsStorage>);
+	RUN_TESTS(TrieMatcher<TrieDoubleArrayStorage>);
+	RUN_TESTS(TrieMixMatcher<TrieDoubleArrayStorage>);
+	RUN_TESTS(TrieMatcher<TrieSparseStorage>);
+	RUN_TESTS(TrieMixMatcher<TrieSparseStorage>);
+	RUN_TESTS(BiFmMatcher);
+	RUN_TESTS(RadixMatcher);
+	RUN_TESTS(BurstMatcher<>);
+	RUN_TESTS(BurstMatcher<1>);
 	RUN_TESTS(VectorMatcher);
 	RUN_TESTS(VectorRangeMatcher);
+	RUN_TESTS(FrontCodedBitmapMatcher);
+	RUN_TESTS(FrontCodedVectorMatcher);
+	RUN_TESTS(FrontCodedVectorRangeMatcher);
+	RUN_TESTS(ShardedMatcher<TrieMatcher<TriePoolStorage>>);
+	RUN_TESTS(ShardedMatcher<VectorRangeMatcher>);
+	RUN_TESTS(NumaMatcher<VectorRangeMatcher>);
+	RUN_TESTS(CachedMatcher<VectorRangeMatcher>);
+	RUN_TESTS(FilteredMatcher<TrieMatcher<TriePoolStorage>>);
+	RUN_TESTS(FilteredMatcher<VectorRangeMatcher>);
+	RUN_TESTS(IndexHandle<VectorRangeMatcher>);
+	RUN_TESTS(ParallelMatcher<TrieMatcher<TriePoolStorage>>);
+	RUN_TESTS(ParallelMatcher<VectorRangeMatcher>);
 #undef RUN_TESTS
+	ok = run_sharded_tests<TrieMatcher<TriePoolStorage>>(
+		"ShardedMatcher<TrieMatcher<TriePoolStorage>>") && ok;
+	ok = run_sharded_tests<VectorRangeMatcher>(
+		"ShardedMatcher<VectorRangeMatcher>") && ok;
+	ok = run_parallel_tests<TrieMatcher<TriePoolStorage>>(
+		"ParallelMatcher<TrieMatcher<TriePoolStorage>>") && ok;
+	ok = run_parallel_tests<VectorRangeMatcher>(
+		"ParallelMatcher<VectorRangeMatcher>") && ok;
+	ok = run_cache_tests<TrieMatcher<TriePoolStorage>>(
+		"CachedMatcher<TrieMatcher<TriePoolStorage>>") && ok;
+	ok = run_reload_tests<TrieMatcher<TriePoolStorage>>(
+		"IndexHandle<TrieMatcher<TriePoolStorage>>") && ok;
+	ok = run_reload_tests<VectorRangeMatcher>(
+		"IndexHandle<VectorRangeMatcher>") && ok;
+	ok = run_approx_tests<TrieMatcher<TriePoolStorage>>(
+		"TrieMatcher<TriePoolStorage>") && ok;
+	ok = run_approx_tests<TrieMatcher<TrieLoudsStorage>>(
+		"TrieMatcher<TrieLoudsStorage>") && ok;
+	ok = run_approx_tests<TrieMixMatcher<TriePoolStorage>>(
+		"TrieMixMatcher<TriePoolStorage>") && ok;
+	ok = run_count_tests<TrieMatcher<TriePoolStorage>>(
+		"TrieMatcher<TriePoolStorage>") && ok;
+	ok = run_count_tests<TrieMatcher<TrieLoudsStorage>>(
+		"TrieMatcher<TrieLoudsStorage>") && ok;
+	ok = run_fixed_tests<BasicVectorMatcher>(
+		"FixedLengthMatcher<BasicVectorMatcher>") && ok;
+	ok = run_fixed_tests<TriePoolMatcher>(
+		"FixedLengthMatcher<TriePoolMatcher>") && ok;
+	ok = run_fixed_tests<TrieMixPoolMatcher>(
+		"FixedLengthMatcher<TrieMixPoolMatcher>") && ok;
 	return !ok;
 }
@@ -0,0 +1,139 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_THREAD_POOL_H
+#define H_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+
+
+/* Fixed-size pool of worker threads.  The only operation is
+   parallel_for which calls fn(i) for every i in [0, n) and returns once
+   all calls finished.  The calling thread takes part in the work so
+   a pool with no workers runs everything serially and nested calls
+   cannot deadlock. */
+struct ThreadPool {
+	explicit ThreadPool(unsigned workers) COLD {
+		for (; workers; --workers) {
+			threads.emplace_back(&ThreadPool::work, this);
+		}
+	}
+
+	~ThreadPool() COLD {
+		{
+			std::lock_guard lock(mutex);
+			stopped = true;
+		}
+		cond.notify_all();
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+	}
+
+	unsigned size() const { return threads.size(); }
+
+	template <class Fn>
+	void parallel_for(size_t n, const Fn &fn);
+
+private:
+	/* State of a single parallel_for call.  Helpers may be scheduled
+	   after the call returned so they hold it through a shared_ptr and
+	   only touch fn after claiming an index. */
+	struct Job {
+		const std::function<void(size_t)> *fn;
+		size_t n;
+		std::atomic<size_t> next = 0;
+		std::atomic<size_t> done = 0;
+
+		void run() {
+			size_t finished = 0;
+			for (size_t i; (i = next++) < n; ++finished) {
+				(*fn)(i);
+			}
+			if (finished && (done += finished) == n) {
+				done.notify_all();
+			}
+		}
+	};
+
+	void work() {
+		std::unique_lock lock(mutex);
+		for (;;) {
+			cond.wait(lock, [this]{
+				return stopped || !queue.empty();
+			});
+			if (queue.empty()) {
+				return;
+			}
+			std::shared_ptr<Job> job = std::move(queue.front());
+			queue.pop_front();
+			lock.unlock();
+			job->run();
+			lock.lock();
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::shared_ptr<Job>> queue;
+	bool stopped = false;
+};
+
+
+template <class Fn>
+void ThreadPool::parallel_for(size_t n, const Fn &fn) {
+	const size_t helpers = std::min<size_t>(threads.size(), n ? n - 1 : 0);
+	if (!helpers) {
+		for (size_t i = 0; i < n; ++i) {
+			fn(i);
+		}
+		return;
+	}
+
+	const std::function<void(size_t)> func(std::cref(fn));
+	const auto job = std::make_shared<Job>();
+	job->fn = &func;
+	job->n = n;
+	{
+		std::lock_guard lock(mutex);
+		for (size_t i = 0; i < helpers; ++i) {
+			queue.push_back(job);
+		}
+	}
+	if (helpers == 1) {
+		cond.notify_one();
+	} else {
+		cond.notify_all();
+	}
+
+	job->run();
+	for (size_t done; (done = job->done.load()) != n;) {
+		job->done.wait(done);
+	}
+}
+
+
+#endif
@@ -0,0 +1,349 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_TRIE_DOUBLE_ARRAY_H
+#define H_TRIE_DOUBLE_ARRAY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <alloca.h>
+
+#include "trie.h"
+#include "util.h"
+
+
+/* Trie storage using the double-array encoding.  Every node occupies one
+   cell holding base and check; child of node s by character c lives in
+   cell base[s] + c and check of that cell is s, so a transition is an
+   addition and one load which verifies it.  Cells of leaves hold word
+   number in place of base.  Each node also has a bit mask of its
+   children so fan-out visits only the existing ones.  Memory is
+   proportional to number of edges, plus the few cells left unused when
+   placing siblings.
+
+   Like the LOUDS storage, it's static.  insert() only records keys and
+   finish() builds the arrays.  All keys must be of the same length. */
+struct TrieDoubleArrayStorage {
+	struct value_type {
+		constexpr value_type() = default;
+
+		static constexpr value_type from_num(uint32_t value) {
+			return {value | leaf_tag};
+		}
+		constexpr uint32_t as_num() const {
+			return val & ~leaf_tag;
+		}
+
+		constexpr explicit operator bool () const { return val; }
+		constexpr bool     operator!     () const { return !val; }
+
+		constexpr bool operator==(value_type rhs) const {
+			return val == rhs.val;
+		}
+		constexpr bool operator!=(value_type rhs) const {
+			return val != rhs.val;
+		}
+
+	private:
+		static constexpr uint32_t leaf_tag = UINT32_C(1) << 31;
+
+		constexpr value_type(uint32_t v) : val(v) {}
+
+		/* Zero for null, cell number for internal nodes and value with
+		   leaf_tag set for leaves. */
+		uint32_t val = 0;
+
+		friend TrieDoubleArrayStorage;
+	};
+
+	static constexpr value_type null() { return {}; }
+
+	/* Adds a new root.  Roots take the first cells. */
+	value_type add_node() COLD {
+		pending.emplace_back();
+		return {static_cast<uint32_t>(pending.size())};
+	}
+
+	template <class It>
+	void insert(value_type root, It firstChar, It lastChar,
+	            value_type data) COLD;
+
+	template <class It>
+	void insert_sorted(value_type root, It first, It last,
+	                   size_t length) COLD;
+
+	void finish() COLD;
+
+	void free_trie(value_type, size_t) COLD {}
+
+	value_type follow(value_type node_pos, std::string_view str) const HOT {
+		for (const char ch : str) {
+			node_pos = follow(node_pos, ch);
+		}
+		return node_pos;
+	}
+
+	value_type follow(value_type node_pos, char ch) const HOT {
+		if (!node_pos) {
+			return null();
+		}
+		const uint32_t cell = cells[node_pos.val].base + code(ch);
+		return cells[cell].check == node_pos.val ? value(cell) : null();
+	}
+
+	/* Calls fn(args..., value) for every value depth levels below
+	   node_pos.  fn returns whether to continue; if it returns false the
+	   walk stops and false is returned.  MaxDepth, if not zero, is an
+	   upper bound of depth known at compile time. */
+	template <size_t MaxDepth = 0, class Fn, class... Args>
+	bool deep_fan_out(value_type node_pos, size_t depth,
+	                  const Fn &fn, Args&&... args) const HOT;
+
+	template <class Fn, class... Args>
+	bool fan_out(value_type node_pos,
+	             const Fn &fn, Args&&... args) const HOT;
+
+	size_t memory_usage() const {
+		return cells.capacity() * sizeof cells[0] +
+			children.capacity() * sizeof children[0];
+	}
+
+private:
+	struct Cell {
+		uint32_t base = 0, check = 0;
+	};
+
+	/* Children still to visit: base of their parent and mask of their
+	   characters. */
+	struct Frame {
+		uint32_t base, mask;
+	};
+
+	static constexpr uint32_t code(char ch) { return ch - 'a' + 1; }
+
+	value_type value(uint32_t cell) const HOT {
+		const uint32_t base = cells[cell].base;
+		return base & value_type::leaf_tag ? value_type(base)
+		                                   : value_type(cell);
+	}
+
+	uint32_t place(uint32_t mask) COLD;
+
+	std::vector<PendingKeys> pending;
+	std::vector<Cell> cells;
+	std::vector<uint32_t> children;
+	std::vector<bool> used;
+	size_t first_free = 0;
+};
+
+
+template <class It>
+void TrieDoubleArrayStorage::insert(value_type root,
+                                    It firstChar, It lastChar,
+                                    value_type data) {
+	pending[root.val - 1].add(firstChar, lastChar, data.as_num());
+}
+
+
+template <class It>
+void TrieDoubleArrayStorage::insert_sorted(value_type root,
+                                           It first, It last, size_t) {
+	for (; first != last; ++first) {
+		const std::string_view key = first->first;
+		insert(root, key.begin(), key.end(),
+		       value_type::from_num(first->second));
+	}
+}
+
+
+/* Finds base at which cells for all characters in mask are free, marks
+   them used and returns it.  Search starts at the first free cell so
+   siblings of nearby nodes end up close together. */
+inline uint32_t TrieDoubleArrayStorage::place(uint32_t mask) {
+	const uint32_t lowest = __builtin_ctz(mask);
+	for (size_t cell = first_free;; ++cell) {
+		if (cell + 32 > used.size()) {
+			used.resize(used.size() * 2 + 64);
+		}
+		if (used[cell] || cell < lowest) {
+			continue;
+		}
+		const size_t base = cell - lowest;
+		bool fits = true;
+		for (uint32_t m = mask; fits && m; m &= m - 1) {
+			fits = !used[base + __builtin_ctz(m)];
+		}
+		if (!fits) {
+			continue;
+		}
+		for (uint32_t m = mask; m; m &= m - 1) {
+			used[base + __builtin_ctz(m)] = true;
+		}
+		while (first_free < used.size() && used[first_free]) {
+			++first_free;
+		}
+		return base;
+	}
+}
+
+
+inline void TrieDoubleArrayStorage::finish() {
+	struct Range {
+		uint32_t cell, lo, hi, depth;
+	};
+
+	const uint32_t roots = pending.size();
+	used.assign(roots + 1, true);
+	first_free = roots + 1;
+	cells.resize(roots + 1);
+	children.resize(roots + 1);
+
+	/* Cells past the last used one must still be there as long as
+	   follow() may look at them. */
+	size_t size = roots + 1 + 26;
+
+	std::vector<Range> stack;
+	std::vector<uint32_t> bases, masks;
+	for (uint32_t root = 0; root < roots; ++root) {
+		const PendingKeys &keys = pending[root];
+		const size_t length = keys.length;
+		const std::vector<uint32_t> idx = keys.sorted();
+		const auto key = [&keys](uint32_t i) { return keys.key(i); };
+
+		/* Depth-first so a node's children are placed right after
+		   its siblings' and a walk down stays in nearby cells. */
+		if (length && !idx.empty()) {
+			stack.push_back({root + 1, 0,
+			                 static_cast<uint32_t>(idx.size()), 0});
+		}
+		while (!stack.empty()) {
+			const Range range = stack.back();
+			stack.pop_back();
+
+			uint32_t mask = 0;
+			for (uint32_t i = range.lo; i < range.hi; ++i) {
+				mask |= 1u << code(key(idx[i])[range.depth]);
+			}
+			const uint32_t base = place(mask);
+			size = std::max<size_t>(size, base + 27);
+			if (cells.size() < size) {
+				cells.resize(std::max(cells.size() * 2, size));
+				children.resize(cells.size());
+			}
+			cells[range.cell].base = base;
+			children[range.cell] = mask;
+
+			const bool leaves = range.depth + 1 == length;
+			const size_t end = stack.size();
+			for (uint32_t lo = range.lo; lo < range.hi;) {
+				const char ch = key(idx[lo])[range.depth];
+				uint32_t hi = lo + 1;
+				while (hi < range.hi &&
+				       key(idx[hi])[range.depth] == ch) {
+					++hi;
+				}
+				const uint32_t cell = base + code(ch);
+				cells[cell].check = range.cell;
+				if (leaves) {
+					cells[cell].base = value_type::from_num(
+						keys.values[idx[lo]]).val;
+				} else {
+					stack.push_back({cell, lo, hi,
+					                 range.depth + 1});
+				}
+				lo = hi;
+			}
+			/* Visit children in character order. */
+			std::reverse(stack.begin() + end, stack.end());
+		}
+	}
+
+	cells.resize(size);
+	cells.shrink_to_fit();
+	children.resize(size);
+	children.shrink_to_fit();
+	pending = {};
+	used = {};
+}
+
+
+template <class Fn, class... Args>
+bool TrieDoubleArrayStorage::fan_out(
+	value_type node_pos, const Fn &fn, Args&&... args) const {
+	if (!node_pos) {
+		return true;
+	}
+	const uint32_t base = cells[node_pos.val].base;
+	for (uint32_t mask = children[node_pos.val]; mask; mask &= mask - 1) {
+		const uint32_t cell = base + __builtin_ctz(mask);
+		if (!fn(std::forward<Args>(args)..., value(cell))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+template <size_t MaxDepth, class Fn, class... Args>
+bool TrieDoubleArrayStorage::deep_fan_out(
+	value_type node_pos, size_t depth, const Fn &fn, Args&&... args) const {
+	if (!depth || !node_pos) {
+		return !node_pos || fn(std::forward<Args>(args)..., node_pos);
+	}
+
+	Frame fixed[MaxDepth ? MaxDepth : 1];
+	const bool use_alloca = depth <= 4096 / sizeof(Frame);
+	Frame *const stack = MaxDepth ? fixed :
+		reinterpret_cast<Frame*>(
+			use_alloca ? alloca(depth * sizeof *stack)
+			           : malloc(depth * sizeof *stack));
+	Frame *sp = stack, *const last = stack + depth - 1;
+
+	*sp = { cells[node_pos.val].base, children[node_pos.val] };
+	bool ret = true;
+	for (;;) {
+		if (!sp->mask) {
+			if (sp == stack) {
+				break;
+			}
+			--sp;
+			continue;
+		}
+		const uint32_t cell = sp->base + __builtin_ctz(sp->mask);
+		sp->mask &= sp->mask - 1;
+		if (sp != last) {
+			++sp;
+			*sp = { cells[cell].base, children[cell] };
+		} else if (!fn(std::forward<Args>(args)..., value(cell))) {
+			ret = false;
+			break;
+		}
+	}
+
+	if (!MaxDepth && !use_alloca) {
+		free(stack);
+	}
+	return ret;
+}
+
+
+#endif
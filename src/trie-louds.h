@@ -0,0 +1,319 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_TRIE_LOUDS_H
+#define H_TRIE_LOUDS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <alloca.h>
+
+#include "bit-vector.h"
+#include "trie.h"
+#include "util.h"
+
+
+/* Succinct trie storage using Level-Order Unary Degree Sequence.  Nodes
+   are numbered in breadth-first order over the whole forest (roots
+   first) and every node is written to a bit vector as one bit set per
+   child followed by a zero.  The children of node i are then numbered
+   consecutively starting with number of set bits before node i's run
+   (i.e. its start minus i) and their labels are kept in a byte array
+   indexed the same way.  That's about two bits plus one byte per node.
+
+   The structure is static.  insert() only records keys and finish(),
+   which must be called once all keys are inserted, builds it.  All keys
+   must be of the same length so leaves form the last level; values live
+   in a separate array indexed by leaf number. */
+struct TrieLoudsStorage {
+	struct value_type {
+		constexpr value_type() = default;
+
+		static constexpr value_type from_num(uint32_t value) {
+			return {value | leaf_tag};
+		}
+		constexpr uint32_t as_num() const {
+			return val & ~leaf_tag;
+		}
+
+		constexpr explicit operator bool () const { return val; }
+		constexpr bool     operator!     () const { return !val; }
+
+		constexpr bool operator==(value_type rhs) const {
+			return val == rhs.val;
+		}
+		constexpr bool operator!=(value_type rhs) const {
+			return val != rhs.val;
+		}
+
+	private:
+		static constexpr uint32_t leaf_tag = UINT32_C(1) << 31;
+
+		constexpr value_type(uint32_t v) : val(v) {}
+
+		/* Zero for null, node number plus one for internal nodes and
+		   value with leaf_tag set for leaves. */
+		uint32_t val = 0;
+
+		friend TrieLoudsStorage;
+	};
+
+	static constexpr value_type null() { return {}; }
+
+	/* Adds a new root. */
+	value_type add_node() COLD {
+		pending.emplace_back();
+		return {static_cast<uint32_t>(pending.size())};
+	}
+
+	template <class It>
+	void insert(value_type root, It firstChar, It lastChar,
+	            value_type data) COLD;
+
+	/* Structure is built by finish() anyway so keys are just recorded
+	   one by one. */
+	template <class It>
+	void insert_sorted(value_type root, It first, It last,
+	                   size_t length) COLD;
+
+	void finish() COLD;
+
+	void free_trie(value_type, size_t) COLD {}
+
+	value_type follow(value_type node_pos, std::string_view str) const HOT {
+		for (const char ch : str) {
+			node_pos = follow(node_pos, ch);
+		}
+		return node_pos;
+	}
+
+	value_type follow(value_type node_pos, char ch) const HOT {
+		if (!node_pos) {
+			return null();
+		}
+		const uint32_t id = node_pos.val - 1;
+		const size_t start = run_start(id);
+		const size_t end = louds.next0(start);
+		const uint32_t first = start - id;
+		for (uint32_t edge = first; edge < first + (end - start); ++edge) {
+			if (labels[edge] == ch) {
+				return child(edge);
+			} else if (labels[edge] > ch) {
+				break;
+			}
+		}
+		return null();
+	}
+
+	/* Calls fn(args..., value) for every value depth levels below
+	   node_pos.  fn returns whether to continue; if it returns false the
+	   walk stops and false is returned.  MaxDepth, if not zero, is an
+	   upper bound of depth known at compile time. */
+	template <size_t MaxDepth = 0, class Fn, class... Args>
+	bool deep_fan_out(value_type node_pos, size_t depth,
+	                  const Fn &fn, Args&&... args) const HOT;
+
+	template <class Fn, class... Args>
+	bool fan_out(value_type node_pos,
+	             const Fn &fn, Args&&... args) const HOT;
+
+	size_t memory_usage() const {
+		return louds.memory_usage() + labels.capacity() +
+			values.capacity() * sizeof values[0];
+	}
+
+private:
+	/* Range of child numbers to visit.  start is where the run of the
+	   next node opened into the frame begins or SIZE_MAX if unknown;
+	   nodes opened into a frame during a walk have consecutive numbers
+	   so only the first one needs a select. */
+	struct Frame {
+		uint32_t next, last;
+		size_t start;
+	};
+
+	size_t run_start(uint32_t id) const HOT {
+		return id ? louds.select0(id - 1) + 1 : 0;
+	}
+
+	/* Returns value of node reached by given edge. */
+	value_type child(uint32_t edge) const HOT {
+		const uint32_t id = roots + edge;
+		return id < first_leaf ? value_type(id + 1)
+			: value_type::from_num(values[id - first_leaf]);
+	}
+
+	void open(Frame &frame, uint32_t id) const HOT {
+		if (frame.start == SIZE_MAX) {
+			frame.start = run_start(id);
+		}
+		const size_t end = louds.next0(frame.start);
+		frame.next = frame.start - id;
+		frame.last = frame.next + (end - frame.start);
+		frame.start = end + 1;
+	}
+
+	std::vector<PendingKeys> pending;
+	BitVector louds;
+	std::vector<char> labels;
+	std::vector<uint32_t> values;
+	uint32_t roots = 0;
+	uint32_t first_leaf = UINT32_MAX;
+};
+
+
+template <class It>
+void TrieLoudsStorage::insert(value_type root, It firstChar, It lastChar,
+                              value_type data) {
+	pending[root.val - 1].add(firstChar, lastChar, data.as_num());
+}
+
+
+template <class It>
+void TrieLoudsStorage::insert_sorted(value_type root, It first, It last,
+                                     size_t) {
+	for (; first != last; ++first) {
+		const std::string_view key = first->first;
+		insert(root, key.begin(), key.end(),
+		       value_type::from_num(first->second));
+	}
+}
+
+
+inline void TrieLoudsStorage::finish() {
+	struct Range {
+		uint32_t root, lo, hi;
+	};
+
+	/* Sort keys of each root. */
+	std::vector<std::vector<uint32_t>> order(pending.size());
+	std::vector<Range> level, next;
+	for (uint32_t root = 0; root < pending.size(); ++root) {
+		const std::vector<uint32_t> &idx =
+			order[root] = pending[root].sorted();
+		level.push_back({root, 0, static_cast<uint32_t>(idx.size())});
+	}
+	roots = pending.size();
+
+	/* Walk the tries breadth first.  Each node is a range of sorted keys
+	   sharing the first depth characters. */
+	uint32_t id = 0;
+	for (size_t depth = 0; !level.empty(); ++depth) {
+		for (const Range &range : level) {
+			const PendingKeys &keys = pending[range.root];
+			const std::vector<uint32_t> &idx = order[range.root];
+			const auto key = [&keys, &idx](uint32_t i) {
+				return keys.key(idx[i]);
+			};
+			/* A root with no keys has no length set and no
+			   children. */
+			if (depth == keys.length && range.lo < range.hi) {
+				first_leaf = std::min(first_leaf, id);
+				values.push_back(keys.values[idx[range.lo]]);
+			} else {
+				for (uint32_t lo = range.lo; lo < range.hi;) {
+					const char ch = key(lo)[depth];
+					uint32_t hi = lo + 1;
+					while (hi < range.hi && key(hi)[depth] == ch) {
+						++hi;
+					}
+					louds.push_back(1);
+					labels.push_back(ch);
+					next.push_back({range.root, lo, hi});
+					lo = hi;
+				}
+			}
+			louds.push_back(0);
+			++id;
+		}
+		level.swap(next);
+		next.clear();
+	}
+
+	louds.build();
+	labels.shrink_to_fit();
+	values.shrink_to_fit();
+	pending = {};
+}
+
+
+template <class Fn, class... Args>
+bool TrieLoudsStorage::fan_out(
+	value_type node_pos, const Fn &fn, Args&&... args) const {
+	if (!node_pos) {
+		return true;
+	}
+	Frame frame = { 0, 0, SIZE_MAX };
+	open(frame, node_pos.val - 1);
+	for (; frame.next < frame.last; ++frame.next) {
+		if (!fn(std::forward<Args>(args)..., child(frame.next))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+template <size_t MaxDepth, class Fn, class... Args>
+bool TrieLoudsStorage::deep_fan_out(
+	value_type node_pos, size_t depth, const Fn &fn, Args&&... args) const {
+	if (!depth || !node_pos) {
+		return !node_pos || fn(std::forward<Args>(args)..., node_pos);
+	}
+
+	Frame fixed[MaxDepth ? MaxDepth : 1];
+	const bool use_alloca = depth <= 4096 / sizeof(Frame);
+	Frame *const stack = MaxDepth ? fixed :
+		reinterpret_cast<Frame*>(
+			use_alloca ? alloca(depth * sizeof *stack)
+			           : malloc(depth * sizeof *stack));
+	Frame *sp = stack, *const last = stack + depth - 1;
+	for (Frame *frame = stack; frame <= last; ++frame) {
+		frame->start = SIZE_MAX;
+	}
+
+	open(*sp, node_pos.val - 1);
+	bool ret = true;
+	for (;;) {
+		if (sp->next == sp->last) {
+			if (sp == stack) {
+				break;
+			}
+			--sp;
+		} else if (sp != last) {
+			const uint32_t edge = sp->next++;
+			++sp;
+			open(*sp, roots + edge);
+		} else if (!fn(std::forward<Args>(args)..., child(sp->next++))) {
+			ret = false;
+			break;
+		}
+	}
+
+	if (!MaxDepth && !use_alloca) {
+		free(stack);
+	}
+	return ret;
+}
+
+
+#endif
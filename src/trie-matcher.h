@@ -17,55 +17,148 @@
 #ifndef H_TRIE_MATCHER_H
 #define H_TRIE_MATCHER_H
 
+#include <cstdint>
+#include <string>
 #include <utility>
+#include <vector>
 #include <algorithm>
 
+#include "query-stats.h"
+#include "result-sink.h"
 #include "trie.h"
 #include "util.h"
 #include "words.h"
 
 
-template <class Trie>
+template <class Trie, size_t N = 0>
 struct TrieMatcher {
+	/* Whether storage knows how many values are below each node.  If it
+	   does, queries with both prefix and suffix walk both tries and fan
+	   out from the smaller subtree rather than guessing by length. */
+	static constexpr bool counts_leaves =
+		requires (const Trie &trie) { trie.leaves(Trie::null()); };
+
 	TrieMatcher(const Words &words) COLD;
 	~TrieMatcher() COLD;
 
-	constexpr size_t size() const { return count; }
+	constexpr size_t size() const { return word_count; }
 	constexpr size_t word_length() const { return length; }
-	template <class Callback>
+	size_t memory_usage() const {
+		return sizeof *this + nodes.memory_usage();
+	}
+	template <class Callback, class Stats = NoStats>
 	size_t query(std::string_view prefix,
 	             std::string_view suffix,
-	             Callback &cb) const HOT;
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const HOT;
+
+	/* Reports words of chunk-th of chunks parts query splits its result
+	   into.  Chunks are formed by the first letter below the node query
+	   fans out from so they can run concurrently and concatenated in
+	   order give the same result as query.  Being split by letter, at
+	   most 26 chunks have any work to do. */
+	template <class Callback, class Stats = NoStats>
+	size_t query_chunk(std::string_view prefix, std::string_view suffix,
+	                   size_t chunk, size_t chunks,
+	                   Callback &cb, size_t limit = SIZE_MAX,
+	                   Stats &&stats = {}) const HOT;
+	static constexpr size_t max_chunks = 26;
+
+	/* Returns number of words in subtree query fans out from, an upper
+	   bound of what it reports. */
+	size_t estimate(std::string_view prefix, std::string_view suffix) const
+		requires counts_leaves;
+
+	/* Returns number of words query would report.  With a storage which
+	   keeps leaf counts this takes O(|prefix| + |suffix|) steps when
+	   either of them is empty. */
+	size_t count(std::string_view prefix,
+	             std::string_view suffix) const HOT;
+
+	/* Like query but also reports words which differ from the pattern
+	   in up to max_mismatches characters of the prefix and suffix. */
+	template <class Callback>
+	size_t query_approx(std::string_view prefix,
+	                    std::string_view suffix, size_t max_mismatches,
+	                    Callback &cb, size_t limit = SIZE_MAX) const HOT;
+
+	/* Typeahead cursor.  Remembers forward trie node reached by the
+	   prefix typed so far and reverse trie node reached by the suffix so
+	   extending the prefix costs a single trie step. */
+	struct Cursor {
+		explicit Cursor(const TrieMatcher &matcher)
+			: matcher(matcher), fwd(matcher.fwd_trie_root),
+			  rev(matcher.rev_trie_root) {}
+
+		void extend_prefix(char ch) HOT;
+		void set_suffix(std::string_view suffix);
+
+		template <class Callback>
+		size_t query(Callback &cb, size_t limit = SIZE_MAX) const HOT;
+
+	private:
+		const TrieMatcher &matcher;
+		typename Trie::value_type fwd, rev;
+		std::string prefix, suffix;
+	};
+
+	Cursor cursor() const { return Cursor(*this); }
 
 private:
+	typename Trie::value_type orient(std::string_view &prefix,
+	                                 std::string_view &suffix) const HOT;
+	typename Trie::value_type reverse(std::string_view &prefix,
+	                                  std::string_view &suffix) const HOT;
+
+	/* Returns node query fans out from, or null if there are no matches,
+	   and replaces prefix and suffix with the path leading to it and
+	   what remains to be followed below it. */
+	template <class Stats>
+	typename Trie::value_type locate(std::string_view &prefix,
+	                                 std::string_view &suffix,
+	                                 Stats &stats) const HOT;
+
+	template <class Callback, class Stats = NoStats>
+	size_t fan_out(typename Trie::value_type node, size_t depth,
+	               std::string_view rest, Callback &cb, size_t limit,
+	               Stats &&stats = {}) const HOT;
+
 	Trie nodes;
 	const typename Trie::value_type fwd_trie_root;
 	const typename Trie::value_type rev_trie_root;
-	const size_t count;
-	const size_t length;
+	const size_t word_count;
+	[[no_unique_address]] const WordLength<N> length;
 
 	TrieMatcher() = delete;
 	TrieMatcher(const TrieMatcher&) = delete;
 };
 
 
-template <class Trie>
-TrieMatcher<Trie>::TrieMatcher(const Words &words)
+template <class Trie, size_t N>
+TrieMatcher<Trie, N>::TrieMatcher(const Words &words)
 	: fwd_trie_root(words.word_length() ? nodes.add_node() : Trie::null()),
 	  rev_trie_root(words.word_length() ? nodes.add_node() : Trie::null()),
-	  count(words.size()), length(words.word_length()) {
+	  word_count(words.size()), length(words.word_length()) {
+	nodes.insert_sorted(fwd_trie_root, words.begin(), words.end(),
+	                    length);
+
+	/* A vector sorts much faster than Words::reverse() builds a map. */
+	std::vector<std::pair<std::string, size_t>> reversed;
+	reversed.reserve(words.size());
 	for (const auto &pair : words) {
 		const std::string &word = pair.first;
-		nodes.insert(fwd_trie_root, word.begin(), word.end(),
-		             Trie::value_type::from_num(pair.second));
-		nodes.insert(rev_trie_root, word.rbegin(), word.rend(),
-		             Trie::value_type::from_num(pair.second));
+		reversed.emplace_back(std::string(word.rbegin(), word.rend()),
+		                      pair.second);
 	}
+	std::sort(reversed.begin(), reversed.end());
+	nodes.insert_sorted(rev_trie_root, reversed.begin(), reversed.end(),
+	                    length);
+	nodes.finish();
 }
 
 
-template <class Trie>
-TrieMatcher<Trie>::~TrieMatcher() {
+template <class Trie, size_t N>
+TrieMatcher<Trie, N>::~TrieMatcher() {
 	if (length) {
 		nodes.free_trie(fwd_trie_root, length - 1);
 		nodes.free_trie(rev_trie_root, length - 1);
@@ -73,54 +166,286 @@ TrieMatcher<Trie>::~TrieMatcher() {
 }
 
 
-template <class Trie>
-template <class Callback>
-size_t TrieMatcher<Trie>::query(std::string_view prefix,
-                                std::string_view suffix,
-                                Callback &cb) const {
-	/* No, we're not pretending to be thread-safe. */
-	static std::vector<char> buffer;
-
-	typename Trie::value_type node;
+/* Picks the trie to walk, forward one if prefix is at least as long as
+   suffix and reverse one otherwise, and returns its root.  In the latter
+   case replaces prefix and suffix with reversed suffix and prefix. */
+template <class Trie, size_t N>
+typename Trie::value_type
+TrieMatcher<Trie, N>::orient(std::string_view &prefix,
+                             std::string_view &suffix) const {
 	if (__builtin_expect(prefix.size() >= suffix.size(), 1)) {
-		node = fwd_trie_root;
-	} else {
-		node = rev_trie_root;
+		return fwd_trie_root;
+	}
+	return reverse(prefix, suffix);
+}
 
-		if (buffer.size() < word_length()) {
-			buffer.resize(word_length());
+
+/* Replaces prefix and suffix with reversed suffix and prefix and returns
+   root of the reverse trie. */
+template <class Trie, size_t N>
+typename Trie::value_type
+TrieMatcher<Trie, N>::reverse(std::string_view &prefix,
+                              std::string_view &suffix) const {
+	/* Scratch space is per thread so concurrent queries are safe. */
+	static thread_local std::vector<char> buffer;
+
+	if (buffer.size() < word_length()) {
+		buffer.resize(word_length());
+	}
+
+	/* Reverse prefix and suffix */
+	auto buf = buffer.data();
+	auto ptr = std::copy(prefix.rbegin(), prefix.rend(), buf);
+	std::copy(suffix.rbegin(), suffix.rend(), ptr);
+
+	/* Swap prefix and suffix */
+	const size_t prefix_size = prefix.size();
+	const size_t suffix_size = suffix.size();
+	suffix = std::string_view(buf, prefix_size);
+	prefix = std::string_view(ptr, suffix_size);
+	return rev_trie_root;
+}
+
+
+template <class Trie, size_t N>
+template <class Callback, class Stats>
+size_t TrieMatcher<Trie, N>::query(std::string_view prefix,
+                                   std::string_view suffix,
+                                   Callback &cb, size_t limit,
+                                   Stats &&stats) const {
+	const auto node = locate(prefix, suffix, stats);
+	if (!node) {
+		return 0;
+	}
+	return fan_out(node, length - prefix.size() - suffix.size(), suffix,
+	               cb, limit, stats);
+}
+
+
+template <class Trie, size_t N>
+template <class Callback, class Stats>
+size_t TrieMatcher<Trie, N>::query_chunk(std::string_view prefix,
+                                         std::string_view suffix,
+                                         size_t chunk, size_t chunks,
+                                         Callback &cb, size_t limit,
+                                         Stats &&stats) const {
+	const auto node = locate(prefix, suffix, stats);
+	if (!node) {
+		return 0;
+	}
+	const size_t depth = length - prefix.size() - suffix.size();
+	if (!depth) {
+		return chunk ? 0 : fan_out(node, 0, suffix, cb, limit, stats);
+	}
+	size_t cnt = 0;
+	const size_t last = 26 * (chunk + 1) / chunks;
+	for (size_t ch = 26 * chunk / chunks; ch < last && cnt < limit; ++ch) {
+		const auto child = nodes.follow(node, char('a' + ch));
+		if (child) {
+			cnt += fan_out(child, depth - 1, suffix,
+			               cb, limit - cnt, stats);
 		}
+	}
+	return cnt;
+}
 
-		/* Reverse prefix and suffix */
-		auto buf = buffer.data();
-		auto ptr = std::copy(prefix.rbegin(), prefix.rend(), buf);
-		std::copy(suffix.rbegin(), suffix.rend(), ptr);
 
-		/* Swap prefix and suffix */
-		const size_t prefix_size = prefix.size();
-		const size_t suffix_size = suffix.size();
-		suffix = std::string_view(buf, prefix_size);
-		prefix = std::string_view(ptr, suffix_size);
+template <class Trie, size_t N>
+size_t TrieMatcher<Trie, N>::estimate(std::string_view prefix,
+                                      std::string_view suffix) const
+	requires counts_leaves {
+	if (prefix.size() + suffix.size() > length) {
+		return 0;
+	}
+	NoStats stats;
+	const auto node = locate(prefix, suffix, stats);
+	if (!node) {
+		return 0;
 	}
+	return prefix.size() == length ? 1 : nodes.leaves(node);
+}
+
 
-	if (!prefix.empty()) {
-		node = nodes.follow(node, prefix);
-		if (!node) {
-			return 0;
+template <class Trie, size_t N>
+template <class Stats>
+typename Trie::value_type
+TrieMatcher<Trie, N>::locate(std::string_view &prefix,
+                             std::string_view &suffix,
+                             Stats &stats) const {
+	if constexpr (counts_leaves) {
+		if (!prefix.empty() && !suffix.empty() &&
+		    prefix.size() + suffix.size() < length) {
+			const auto fwd = nodes.follow(fwd_trie_root, prefix);
+			stats.follow(prefix.size());
+			if (!fwd) {
+				return Trie::null();
+			}
+			std::string_view rprefix = prefix, rsuffix = suffix;
+			reverse(rprefix, rsuffix);
+			const auto rev = nodes.follow(rev_trie_root, rprefix);
+			stats.follow(rprefix.size());
+			if (!rev || nodes.leaves(fwd) <= nodes.leaves(rev)) {
+				return rev ? fwd : rev;
+			}
+			prefix = rprefix;
+			suffix = rsuffix;
+			return rev;
 		}
 	}
-	size_t count = 0;
-	nodes.deep_fan_out(
-		node, length - prefix.size() - suffix.size(),
-		[n = &nodes, &count, &cb, suffix](auto pos) {
-			pos = n->follow(pos, suffix);
-			if (pos) {
-				cb(pos.as_num());
-				++count;
+
+	const auto root = orient(prefix, suffix);
+	if (prefix.empty()) {
+		return root;
+	}
+	stats.follow(prefix.size());
+	return nodes.follow(root, prefix);
+}
+
+
+template <class Trie, size_t N>
+size_t TrieMatcher<Trie, N>::count(std::string_view prefix,
+                                   std::string_view suffix) const {
+	if (prefix.size() + suffix.size() > length) {
+		return 0;
+	}
+	if constexpr (counts_leaves) {
+		if (prefix.size() + suffix.size() < length &&
+		    (prefix.empty() || suffix.empty())) {
+			const auto node = orient(prefix, suffix);
+			if (prefix.empty()) {
+				return word_count;
 			}
-		});
+			const auto pos = nodes.follow(node, prefix);
+			return pos ? nodes.leaves(pos) : 0;
+		}
+	}
+	const auto ignore = [](uint32_t) {};
+	return query(prefix, suffix, ignore);
+}
+
+
+template <class Trie, size_t N>
+template <class Callback>
+size_t TrieMatcher<Trie, N>::query_approx(std::string_view prefix,
+                                          std::string_view suffix,
+                                          size_t max_mismatches,
+                                          Callback &cb, size_t limit) const {
+	if (!limit || prefix.size() + suffix.size() > length) {
+		return 0;
+	}
+	const typename Trie::value_type root = orient(prefix, suffix);
+	const size_t depth = length - prefix.size() - suffix.size();
+
+	/* Whatever budget the prefix leaves is spent on the suffix. */
+	size_t count = 0;
+	const auto report = [&cb, &count, limit](auto pos, size_t) {
+		cb(pos.as_num());
+		return ++count < limit;
+	};
+	approx_follow(nodes, root, prefix, max_mismatches,
+	              [&](auto node, size_t budget) {
+		return nodes.template deep_fan_out<N>(
+			node, depth, [&](auto pos) {
+				return approx_follow(nodes, pos, suffix, budget,
+				                     report);
+			});
+	});
+	return count;
+}
+
+
+/* Reports words depth levels below node which continue with rest. */
+template <class Trie, size_t N>
+template <class Callback, class Stats>
+size_t TrieMatcher<Trie, N>::fan_out(typename Trie::value_type node,
+                                     size_t depth, std::string_view rest,
+                                     Callback &cb, size_t limit,
+                                     Stats &&stats) const {
+	if (!limit) {
+		return 0;
+	}
+	size_t count = 0;
+	const auto walk = [&](auto &out) {
+		nodes.template deep_fan_out<N>(
+			node, depth,
+			[n = &nodes, &count, &out, &stats,
+			 rest, limit](auto pos) {
+				stats.fan();
+				stats.follow(rest.size());
+				pos = n->follow(pos, rest);
+				if (pos) {
+					out(pos.as_num());
+					return ++count < limit;
+				}
+				stats.filter();
+				return true;
+			});
+	};
+	/* A sink gets ids in runs collected on the stack. */
+	if constexpr (ResultSink<Callback>) {
+		BufferedSink<Callback> out(cb);
+		walk(out);
+	} else {
+		walk(cb);
+	}
+	stats.emit(count);
 	return count;
 }
 
 
+template <class Trie, size_t N>
+void TrieMatcher<Trie, N>::Cursor::extend_prefix(char ch) {
+	if (fwd && prefix.size() < matcher.length) {
+		fwd = matcher.nodes.follow(fwd, ch);
+	}
+	prefix.push_back(ch);
+}
+
+
+template <class Trie, size_t N>
+void TrieMatcher<Trie, N>::Cursor::set_suffix(std::string_view sfx) {
+	suffix.assign(sfx);
+	rev = matcher.rev_trie_root;
+	if (rev && suffix.size() <= matcher.length) {
+		for (auto it = suffix.rbegin(); rev && it != suffix.rend();) {
+			rev = matcher.nodes.follow(rev, *it++);
+		}
+	}
+}
+
+
+template <class Trie, size_t N>
+template <class Callback>
+size_t TrieMatcher<Trie, N>::Cursor::query(Callback &cb, size_t limit) const {
+	/* Scratch space is per thread so concurrent queries are safe. */
+	static thread_local std::string buffer;
+
+	if (prefix.size() + suffix.size() > matcher.length) {
+		return 0;
+	}
+	const size_t depth = matcher.length - prefix.size() - suffix.size();
+	bool forward = prefix.size() >= suffix.size();
+	if constexpr (counts_leaves) {
+		if (!prefix.empty() && !suffix.empty() && depth) {
+			if (!fwd || !rev) {
+				return 0;
+			}
+			forward = matcher.nodes.leaves(fwd) <=
+				matcher.nodes.leaves(rev);
+		}
+	}
+	if (forward) {
+		return fwd ? matcher.fan_out(fwd, depth, suffix, cb, limit) : 0;
+	}
+	buffer.assign(prefix.rbegin(), prefix.rend());
+	return rev ? matcher.fan_out(rev, depth, buffer, cb, limit) : 0;
+}
+
+
+/* Pool backed matcher parametrised by word length only, as needed by
+   FixedLengthMatcher. */
+template <size_t N>
+using TriePoolMatcher = TrieMatcher<TriePoolStorage, N>;
+
+
 #endif
@@ -17,16 +17,22 @@
 #ifndef H_TRIE_MIX_MATCHER_H
 #define H_TRIE_MIX_MATCHER_H
 
+#include <cstdint>
 #include <cstring>
 #include <utility>
 #include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 #include "trie.h"
+#include "query-cursor.h"
+#include "query-stats.h"
 #include "util.h"
 #include "words.h"
 
 
-template <class Trie>
+template <class Trie, size_t N = 0>
 struct TrieMixMatcher {
 	using Query = std::pair<std::string_view, std::string_view>;
 
@@ -35,16 +41,41 @@ struct TrieMixMatcher {
 
 	constexpr size_t size() const { return count; }
 	constexpr size_t word_length() const { return length; }
-	template <class Callback>
+	size_t memory_usage() const {
+		return sizeof *this + nodes.memory_usage();
+	}
+	template <class Callback, class Stats = NoStats>
 	size_t query(std::string_view prefix,
 	             std::string_view suffix,
-	             Callback &cb) const HOT;
+	             Callback &cb, size_t limit = SIZE_MAX,
+	             Stats &&stats = {}) const {
+		return crawl(prefix, suffix, 0, cb, limit, stats);
+	}
+
+	/* Like query but also reports words which differ from the pattern
+	   in up to max_mismatches characters of the prefix and suffix. */
+	template <class Callback>
+	size_t query_approx(std::string_view prefix,
+	                    std::string_view suffix, size_t max_mismatches,
+	                    Callback &cb, size_t limit = SIZE_MAX) const {
+		return crawl(prefix, suffix, max_mismatches, cb, limit);
+	}
+
+	QueryCursor<TrieMixMatcher> cursor() const {
+		return QueryCursor(*this);
+	}
 
 private:
+	template <class Callback, class Stats = NoStats>
+	size_t crawl(std::string_view prefix,
+	             std::string_view suffix, size_t max_mismatches,
+	             Callback &cb, size_t limit,
+	             Stats &&stats = {}) const HOT;
+
 	Trie nodes;
 	const typename Trie::value_type trie_root;
 	const size_t count;
-	const size_t length;
+	[[no_unique_address]] const WordLength<N> length;
 
 	TrieMixMatcher() = delete;
 	TrieMixMatcher(const TrieMixMatcher&) = delete;
@@ -65,32 +96,51 @@ inline char *mix(char *dst, const char *src, size_t len) {
 }
 
 
-template <class Trie>
-TrieMixMatcher<Trie>::TrieMixMatcher(const Words &words)
+template <class Trie, size_t N>
+TrieMixMatcher<Trie, N>::TrieMixMatcher(const Words &words)
 	: trie_root(words.word_length() ? nodes.add_node() : Trie::null()),
 	  count(words.size()), length(words.word_length()) {
-	auto buf = std::make_unique<char[]>(length);
+	/* Mixing doesn't preserve order so mixed keys need sorting before
+	   they can be bulk loaded.  They are mixed into one flat buffer and
+	   only their indices are sorted. */
+	PendingKeys keys;
+	keys.chars.resize(words.size() * length);
+	keys.values.reserve(words.size());
+	keys.length = length;
+	char *dst = keys.chars.data();
 	for (const auto &pair : words) {
-		nodes.insert(trie_root, buf.get(),
-		             mix(buf.get(), pair.first.data(), length),
-		             Trie::value_type::from_num(pair.second));
+		dst = mix(dst, pair.first.data(), length);
+		keys.values.push_back(pair.second);
 	}
+
+	std::vector<std::pair<std::string_view, uint32_t>> sorted;
+	sorted.reserve(words.size());
+	for (const uint32_t idx : keys.sorted()) {
+		sorted.emplace_back(std::string_view(keys.key(idx), length),
+		                    keys.values[idx]);
+	}
+	nodes.insert_sorted(trie_root, sorted.begin(), sorted.end(), length);
+	nodes.finish();
 }
 
 
-template <class Trie>
-TrieMixMatcher<Trie>::~TrieMixMatcher() {
+template <class Trie, size_t N>
+TrieMixMatcher<Trie, N>::~TrieMixMatcher() {
 	if (length) {
 		nodes.free_trie(trie_root, length - 1);
 	}
 }
 
 
-template <class Trie, class Callback>
+template <class Trie, class Callback, class Stats, size_t N = 0>
 struct Crawler {
-	Crawler(const Trie &n, const char *e, Callback &cb) HOT;
+	Crawler(const Trie &n, const char *e, Callback &cb, size_t limit,
+	        Stats &stats) HOT;
 
-	void operator()(const char *key,
+	/* Walks the trie from value along key, in which '\0' stands for any
+	   character, allowing budget mismatches on the other characters.
+	   Returns whether to continue, i.e. limit has not been reached. */
+	bool operator()(const char *key, size_t budget,
 	                typename Trie::value_type value) const HOT;
 
 	constexpr size_t count() const { return n; }
@@ -99,18 +149,23 @@ private:
 	const Trie &nodes;
 	const char *const key_end;
 	Callback &cb;
+	const size_t limit;
+	Stats &stats;
 	mutable size_t n = 0;
 };
 
 
-template <class Trie, class Callback>
-Crawler<Trie, Callback>::Crawler(const Trie &n, const char *e, Callback &cb)
-	: nodes(n), key_end(e), cb(cb) {}
+template <class Trie, class Callback, class Stats, size_t N>
+Crawler<Trie, Callback, Stats, N>::Crawler(const Trie &n, const char *e,
+                                           Callback &cb, size_t limit,
+                                           Stats &stats)
+	: nodes(n), key_end(e), cb(cb), limit(limit), stats(stats) {}
 
 
-template <class Trie, class Callback>
-void Crawler<Trie, Callback>::operator()(
-	const char *key, typename Trie::value_type value) const {
+template <class Trie, class Callback, class Stats, size_t N>
+bool Crawler<Trie, Callback, Stats, N>::operator()(
+	const char *key, size_t budget, typename Trie::value_type value) const {
+	stats.fan();
 	while (key != key_end) {
 		const char *ptr = key;
 		while (key != key_end && *key == '\0') {
@@ -118,47 +173,75 @@ void Crawler<Trie, Callback>::operator()(
 		}
 		const size_t count = key - ptr;
 		switch (count) {
-		case 0:
-			value = nodes.follow(value, *key++);
+		case 0: {
+			const auto exact = nodes.follow(value, *key++);
+			stats.follow();
+			if (budget && !nodes.fan_out(value, [&](auto child) {
+				return child == exact ||
+					(*this)(key, budget - 1, child);
+			})) {
+				return false;
+			}
+			value = exact;
 			if (!value) {
-				return;
+				stats.filter();
+				return true;
 			}
 			break;
+		}
 		case 1:
-			nodes.fan_out(value, *this, key);
-			return;
+			return nodes.fan_out(value, *this, key, budget);
 		default:
-			nodes.deep_fan_out(value, count, *this, key);
-			return;
+			return nodes.template deep_fan_out<N>(value, count,
+			                                      *this, key,
+			                                      budget);
 		}
 	}
 	cb(value.as_num());
-	++n;
+	stats.emit();
+	return ++n < limit;
 }
 
 
-template <class Trie>
-template <class Callback>
-size_t TrieMixMatcher<Trie>::query(std::string_view prefix,
-                                   std::string_view suffix,
-                                   Callback &cb) const {
-	/* No, we're not pretending to be thread-safe. */
-	static std::vector<char> buffer;
+template <class Trie, size_t N>
+template <class Callback, class Stats>
+size_t TrieMixMatcher<Trie, N>::crawl(std::string_view prefix,
+                                      std::string_view suffix,
+                                      size_t max_mismatches,
+                                      Callback &cb, size_t limit,
+                                      Stats &&stats) const {
+	if (!limit) {
+		return 0;
+	}
 
-	if (__builtin_expect(buffer.size() < length * 2, 0)) {
-		buffer.resize(length * 2);
+	/* With length known at compile time scratch space fits on the stack;
+	   otherwise it is per thread so concurrent queries are safe. */
+	char fixed[N ? N * 2 : 1];
+	char *buf = fixed;
+	if constexpr (!N) {
+		static thread_local std::vector<char> buffer;
+		if (__builtin_expect(buffer.size() < length * 2, 0)) {
+			buffer.resize(length * 2);
+		}
+		buf = buffer.data();
 	}
-	char *const buf = buffer.data();
 	std::memcpy(buf, prefix.data(), prefix.size());
 	std::memset(buf + prefix.size(), '\0',
 	            length - prefix.size() - suffix.size());
 	std::memcpy(buf + length - suffix.size(),
 	            suffix.data(), suffix.size());
 
-	Crawler crawler(nodes, mix(buf + length, buf, length), cb);
-	crawler(buf + length, trie_root);
+	const Crawler<Trie, Callback, std::remove_reference_t<Stats>, N> crawler(
+		nodes, mix(buf + length, buf, length), cb, limit, stats);
+	crawler(buf + length, max_mismatches, trie_root);
 	return crawler.count();
 }
 
 
+/* Pool backed matcher parametrised by word length only, as needed by
+   FixedLengthMatcher. */
+template <size_t N>
+using TrieMixPoolMatcher = TrieMixMatcher<TriePoolStorage, N>;
+
+
 #endif
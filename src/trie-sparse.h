@@ -0,0 +1,294 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_TRIE_SPARSE_H
+#define H_TRIE_SPARSE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <alloca.h>
+
+#include "bit-vector.h"
+#include "trie.h"
+#include "util.h"
+
+
+/* Trie storage with nodes sized to their number of children.  Each node
+   is a 32-bit mask of its children's characters followed by a packed
+   array of the children, all in a single arena.  Child for character c
+   sits at index popcount(mask & ((1 << c) - 1)) of the array, like in
+   a hash array mapped trie, so follow() costs one popcount and fan-out
+   touches only real children.  That's four bytes per edge plus four per
+   node instead of 26 slots per node.
+
+   Nodes are laid out depth first.  The arena cannot grow a node in
+   place so, like the LOUDS storage, the structure is static: insert()
+   only records keys and finish() builds it.  Roots take fixed slots
+   big enough for all 26 children at the start of the arena. */
+struct TrieSparseStorage {
+	struct value_type {
+		constexpr value_type() = default;
+
+		static constexpr value_type from_num(uint32_t value) {
+			return {value | leaf_tag};
+		}
+		constexpr uint32_t as_num() const {
+			return val & ~leaf_tag;
+		}
+
+		constexpr explicit operator bool () const { return val; }
+		constexpr bool     operator!     () const { return !val; }
+
+		constexpr bool operator==(value_type rhs) const {
+			return val == rhs.val;
+		}
+		constexpr bool operator!=(value_type rhs) const {
+			return val != rhs.val;
+		}
+
+	private:
+		static constexpr uint32_t leaf_tag = UINT32_C(1) << 31;
+
+		constexpr value_type(uint32_t v) : val(v) {}
+
+		/* Zero for null, arena offset for internal nodes and value with
+		   leaf_tag set for leaves. */
+		uint32_t val = 0;
+
+		friend TrieSparseStorage;
+	};
+
+	static constexpr value_type null() { return {}; }
+
+	/* Adds a new root. */
+	value_type add_node() COLD {
+		pending.emplace_back();
+		return {root_offset(pending.size() - 1)};
+	}
+
+	template <class It>
+	void insert(value_type root, It firstChar, It lastChar,
+	            value_type data) COLD;
+
+	template <class It>
+	void insert_sorted(value_type root, It first, It last,
+	                   size_t length) COLD;
+
+	void finish() COLD;
+
+	void free_trie(value_type, size_t) COLD {}
+
+	value_type follow(value_type node_pos, std::string_view str) const HOT {
+		for (const char ch : str) {
+			node_pos = follow(node_pos, ch);
+		}
+		return node_pos;
+	}
+
+	value_type follow(value_type node_pos, char ch) const HOT {
+		if (!node_pos) {
+			return null();
+		}
+		const uint32_t *const node = &arena[node_pos.val];
+		const uint32_t bit = UINT32_C(1) << (ch - 'a');
+		return node[0] & bit
+			? value_type(node[1 + popcount(node[0] & (bit - 1))])
+			: null();
+	}
+
+	/* Calls fn(args..., value) for every value depth levels below
+	   node_pos.  fn returns whether to continue; if it returns false the
+	   walk stops and false is returned.  MaxDepth, if not zero, is an
+	   upper bound of depth known at compile time. */
+	template <size_t MaxDepth = 0, class Fn, class... Args>
+	bool deep_fan_out(value_type node_pos, size_t depth,
+	                  const Fn &fn, Args&&... args) const HOT;
+
+	template <class Fn, class... Args>
+	bool fan_out(value_type node_pos,
+	             const Fn &fn, Args&&... args) const HOT;
+
+	size_t memory_usage() const {
+		return arena.capacity() * sizeof arena[0];
+	}
+
+private:
+	/* Children of a node still to visit. */
+	struct Frame {
+		const uint32_t *next, *end;
+	};
+
+	static constexpr uint32_t root_offset(size_t root) {
+		return 1 + root * 27;
+	}
+
+	std::vector<PendingKeys> pending;
+	std::vector<uint32_t> arena;
+};
+
+
+template <class It>
+void TrieSparseStorage::insert(value_type root, It firstChar, It lastChar,
+                               value_type data) {
+	pending[(root.val - 1) / 27].add(firstChar, lastChar, data.as_num());
+}
+
+
+template <class It>
+void TrieSparseStorage::insert_sorted(value_type root, It first, It last,
+                                      size_t) {
+	for (; first != last; ++first) {
+		const std::string_view key = first->first;
+		insert(root, key.begin(), key.end(),
+		       value_type::from_num(first->second));
+	}
+}
+
+
+inline void TrieSparseStorage::finish() {
+	/* Keys [lo, hi) sharing first depth characters make a node.  It is
+	   at given offset, or if that's zero, is yet to be allocated and
+	   its offset stored in given slot of the parent. */
+	struct Range {
+		uint32_t offset, slot, lo, hi, depth;
+	};
+
+	arena.assign(root_offset(pending.size()), 0);
+	std::vector<Range> stack;
+	for (size_t root = 0; root < pending.size(); ++root) {
+		const PendingKeys &keys = pending[root];
+		const std::vector<uint32_t> idx = keys.sorted();
+		const auto key = [&keys, &idx](uint32_t i) {
+			return keys.key(idx[i]);
+		};
+
+		if (keys.length && !idx.empty()) {
+			stack.push_back({root_offset(root), 0, 0,
+			                 static_cast<uint32_t>(idx.size()), 0});
+		}
+		while (!stack.empty()) {
+			Range range = stack.back();
+			stack.pop_back();
+
+			uint32_t mask = 0;
+			for (uint32_t i = range.lo; i < range.hi; ++i) {
+				mask |= UINT32_C(1) << (key(i)[range.depth] - 'a');
+			}
+			if (!range.offset) {
+				range.offset = arena.size();
+				arena.resize(arena.size() + 1 + popcount(mask));
+				arena[range.slot] = range.offset;
+			}
+			arena[range.offset] = mask;
+
+			const bool leaves = range.depth + 1 == keys.length;
+			const size_t end = stack.size();
+			uint32_t slot = range.offset + 1;
+			for (uint32_t lo = range.lo; lo < range.hi; ++slot) {
+				const char ch = key(lo)[range.depth];
+				uint32_t hi = lo + 1;
+				while (hi < range.hi && key(hi)[range.depth] == ch) {
+					++hi;
+				}
+				if (leaves) {
+					arena[slot] = value_type::from_num(
+						keys.values[idx[lo]]).val;
+				} else {
+					stack.push_back({0, slot, lo, hi,
+					                 range.depth + 1});
+				}
+				lo = hi;
+			}
+			/* Visit children in character order so the first one
+			   directly follows its parent. */
+			std::reverse(stack.begin() + end, stack.end());
+		}
+	}
+
+	arena.shrink_to_fit();
+	pending = {};
+}
+
+
+template <class Fn, class... Args>
+bool TrieSparseStorage::fan_out(
+	value_type node_pos, const Fn &fn, Args&&... args) const {
+	if (!node_pos) {
+		return true;
+	}
+	const uint32_t *const node = &arena[node_pos.val];
+	const uint32_t *const end = node + 1 + popcount(node[0]);
+	for (const uint32_t *child = node + 1; child != end; ++child) {
+		if (!fn(std::forward<Args>(args)..., value_type(*child))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+template <size_t MaxDepth, class Fn, class... Args>
+bool TrieSparseStorage::deep_fan_out(
+	value_type node_pos, size_t depth, const Fn &fn, Args&&... args) const {
+	if (!depth || !node_pos) {
+		return !node_pos || fn(std::forward<Args>(args)..., node_pos);
+	}
+
+	Frame fixed[MaxDepth ? MaxDepth : 1];
+	const bool use_alloca = depth <= 4096 / sizeof(Frame);
+	Frame *const stack = MaxDepth ? fixed :
+		reinterpret_cast<Frame*>(
+			use_alloca ? alloca(depth * sizeof *stack)
+			           : malloc(depth * sizeof *stack));
+	Frame *sp = stack, *const last = stack + depth - 1;
+
+	const auto open = [this](Frame &frame, uint32_t offset) {
+		const uint32_t *const node = &arena[offset];
+		frame = { node + 1, node + 1 + popcount(node[0]) };
+	};
+
+	open(*sp, node_pos.val);
+	bool ret = true;
+	for (;;) {
+		if (sp->next == sp->end) {
+			if (sp == stack) {
+				break;
+			}
+			--sp;
+		} else if (sp != last) {
+			const uint32_t offset = *sp->next++;
+			++sp;
+			open(*sp, offset);
+		} else if (!fn(std::forward<Args>(args)...,
+		               value_type(*sp->next++))) {
+			ret = false;
+			break;
+		}
+	}
+
+	if (!MaxDepth && !use_alloca) {
+		free(stack);
+	}
+	return ret;
+}
+
+
+#endif
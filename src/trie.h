@@ -17,8 +17,11 @@
 #ifndef H_TRIE_H
 #define H_TRIE_H
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <limits>
+#include <numeric>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -95,27 +98,49 @@ struct TrieStorageBase {
 		return node(node_pos)[ch - 'a'];
 	}
 
-	template <class Fn, class... Args>
-	void deep_fan_out(value_type node_pos, size_t depth,
+	/* Calls fn(args..., value) for every value depth levels below
+	   node_pos.  fn returns whether to continue; if it returns false the
+	   walk stops and false is returned.  MaxDepth, if not zero, is an
+	   upper bound of depth known at compile time. */
+	template <size_t MaxDepth = 0, class Fn, class... Args>
+	bool deep_fan_out(value_type node_pos, size_t depth,
 	                  const Fn &fn, Args&&... args) const HOT;
 
 	template <class Fn, class... Args>
-	void fan_out(value_type node_pos,
+	bool fan_out(value_type node_pos,
 	             const Fn &fn, Args&&... args) const HOT;
 
 	template <class It>
 	void insert(value_type node_pos, It firstChar, It lastChar,
 	            value_type data) COLD;
 
+	/* Inserts (key, number) pairs from [first, last), all keys length
+	   characters long and given in sorted order.  Nodes on the path to
+	   the previous key are kept on a stack so shared prefixes are never
+	   walked again and new nodes are allocated in DFS order. */
+	template <class It>
+	void insert_sorted(value_type root, It first, It last,
+	                   size_t length) COLD;
+
+	/* Called once all keys are inserted. */
+	void finish() COLD {}
+
+	/* Hints that count more nodes are about to be added. */
+	void reserve(size_t) COLD {}
+
 private:
-	template <class Fn, class... Args>
-	void do_fan_out(value_type node_pos, size_t depth,
+	template <size_t MaxDepth, class Fn, class... Args>
+	bool do_fan_out(value_type node_pos, size_t depth,
 	                const Fn &fn, Args&&... args) const HOT;
 
 	value_type add_node() COLD {
 		return static_cast<Self*>(this)->add_node();
 	}
 
+	/* Called for every inner node on the path of each inserted key.
+	   Storages which keep leaf counts override it. */
+	void count_leaf(value_type) COLD {}
+
 	constexpr node_type &node(value_type data) HOT {
 		return static_cast<Self *>(this)->node(data);
 	}
@@ -129,6 +154,7 @@ template <class It>
 void TrieStorageBase<Value, Self>::insert(
 	value_type node_pos, It firstChar, It lastChar, value_type data) {
 	for (;;) {
+		static_cast<Self *>(this)->count_leaf(node_pos);
 		const char ch = *firstChar++ - 'a';
 		if (firstChar == lastChar) {
 			node(node_pos)[ch] = data;
@@ -145,44 +171,101 @@ void TrieStorageBase<Value, Self>::insert(
 }
 
 
+template <class Value, class Self>
+template <class It>
+void TrieStorageBase<Value, Self>::insert_sorted(
+	value_type root, It first, It last, size_t length) {
+	if (!length) {
+		return;
+	}
+	/* Depth of the deepest node shared with the previous key. */
+	const auto shared = [length](std::string_view key,
+	                             std::string_view prev) {
+		size_t depth = 0;
+		if (!prev.empty()) {
+			while (depth + 1 < length && key[depth] == prev[depth]) {
+				++depth;
+			}
+		}
+		return depth;
+	};
+
+	/* Count new nodes first so storage can allocate them at once. */
+	size_t count = 0;
+	std::string_view prev;
+	for (It it = first; it != last; ++it) {
+		count += length - 1 - shared(it->first, prev);
+		prev = it->first;
+	}
+	static_cast<Self *>(this)->reserve(count);
+
+	std::vector<value_type> path(length);
+	path[0] = root;
+	prev = {};
+	for (; first != last; ++first) {
+		const std::string_view key = first->first;
+		size_t depth = shared(key, prev);
+		for (; depth + 1 < length; ++depth) {
+			const value_type next = add_node();
+			node(path[depth])[key[depth] - 'a'] = next;
+			path[depth + 1] = next;
+		}
+		node(path[depth])[key[depth] - 'a'] =
+			value_type::from_num(first->second);
+		for (depth = 0; depth < length; ++depth) {
+			static_cast<Self *>(this)->count_leaf(path[depth]);
+		}
+		prev = key;
+	}
+}
+
+
 template <class Value, class Self>
 template <class Fn, class... Args>
-void TrieStorageBase<Value, Self>::fan_out(
+bool TrieStorageBase<Value, Self>::fan_out(
 	value_type node_pos, const Fn &fn, Args&&... args) const {
 	for (const value_type data : node(node_pos)) {
-		if (data) {
-			fn(std::forward<Args>(args)..., data);
+		if (data && !fn(std::forward<Args>(args)..., data)) {
+			return false;
 		}
 	}
+	return true;
 }
 
 template <class Value, class Self>
-template <class Fn, class... Args>
-void TrieStorageBase<Value, Self>::deep_fan_out(
+template <size_t MaxDepth, class Fn, class... Args>
+bool TrieStorageBase<Value, Self>::deep_fan_out(
 	value_type node_pos, size_t depth, const Fn &fn, Args&&... args) const {
 	if (depth) {
-		do_fan_out(node_pos, depth,
-			   fn, std::forward<Args>(args)...);
+		return do_fan_out<MaxDepth>(node_pos, depth,
+		                            fn, std::forward<Args>(args)...);
 	} else if (node_pos) {
-		fn(std::forward<Args>(args)..., node_pos);
+		return fn(std::forward<Args>(args)..., node_pos);
+	} else {
+		return true;
 	}
 }
 
 
 template <class Value, class Self>
-template <class Fn, class... Args>
-void TrieStorageBase<Value, Self>::do_fan_out(
+template <size_t MaxDepth, class Fn, class... Args>
+bool TrieStorageBase<Value, Self>::do_fan_out(
 	value_type node_pos, size_t depth, const Fn &fn, Args&&... args) const {
 
+	/* With depth bounded at compile time the stack is a plain array the
+	   compiler can keep track of. */
 	using StackFrame = std::pair<const node_type*, size_t>;
+	StackFrame fixed[MaxDepth ? MaxDepth : 1];
 	const bool use_alloca = depth <= 4096 / sizeof(StackFrame);
-	StackFrame *const stack = reinterpret_cast<StackFrame*>(
-		use_alloca ? alloca(depth * sizeof *stack)
-		           : malloc(depth * sizeof *stack));
+	StackFrame *const stack = MaxDepth ? fixed :
+		reinterpret_cast<StackFrame*>(
+			use_alloca ? alloca(depth * sizeof *stack)
+			           : malloc(depth * sizeof *stack));
 	StackFrame *sp = stack, *const last = stack + depth - 1;
 
 	const node_type *n = sp->first = &node(node_pos);
 	size_t ch_pos = sp->second = 0;
+	bool ret = true;
 
 	for (;;) {
 		node_pos = (*n)[ch_pos++];
@@ -195,8 +278,9 @@ void TrieStorageBase<Value, Self>::do_fan_out(
 			continue;
 		}
 
-		if (node_pos) {
-			fn(std::forward<Args>(args)..., node_pos);
+		if (node_pos && !fn(std::forward<Args>(args)..., node_pos)) {
+			ret = false;
+			goto out;
 		}
 
 		if (ch_pos == 26) {
@@ -212,14 +296,86 @@ void TrieStorageBase<Value, Self>::do_fan_out(
 	}
 
 out:
-	if (!use_alloca) {
+	if (!MaxDepth && !use_alloca) {
 		free(stack);
 	}
+	return ret;
+}
+
+
+/* Keys of one root recorded by a static storage, which builds its
+   structure only once all keys are known, in finish(). */
+struct PendingKeys {
+	template <class It>
+	void add(It first, It last, uint32_t value) {
+		const size_t size = chars.size();
+		chars.append(first, last);
+		length = chars.size() - size;
+		values.push_back(value);
+	}
+
+	const char *key(uint32_t idx) const { return &chars[idx * length]; }
+
+	/* Returns indices of the keys in sorted order. */
+	std::vector<uint32_t> sorted() const COLD;
+
+	std::string chars;
+	std::vector<uint32_t> values;
+	size_t length = 0;
+};
+
+
+inline std::vector<uint32_t> PendingKeys::sorted() const {
+	std::vector<uint32_t> idx(values.size());
+	std::iota(idx.begin(), idx.end(), 0);
+	const auto less = [this](uint32_t a, uint32_t b) {
+		return std::string_view(key(a), length) <
+			std::string_view(key(b), length);
+	};
+	/* Keys usually come from insert_sorted() already in order. */
+	if (!std::is_sorted(idx.begin(), idx.end(), less)) {
+		std::sort(idx.begin(), idx.end(), less);
+	}
+	return idx;
+}
+
+
+/* Calls fn(value, budget) for every value reached from node_pos by
+   following a string which differs from str in at most budget
+   characters, with budget reduced by the number of mismatches on the way.
+   Only walks which spend the budget branch out; the exact path is
+   followed in a loop so recursion depth is bounded by the budget.  fn
+   returns whether to continue; if it returns false the walk stops and
+   false is returned.  Works with any storage. */
+template <class Trie, class Fn>
+bool approx_follow(const Trie &trie, typename Trie::value_type node_pos,
+                   std::string_view str, size_t budget, const Fn &fn) HOT;
+
+template <class Trie, class Fn>
+bool approx_follow(const Trie &trie, typename Trie::value_type node_pos,
+                   std::string_view str, size_t budget, const Fn &fn) {
+	for (size_t i = 0; node_pos && i < str.size(); ++i) {
+		if (!budget) {
+			node_pos = trie.follow(node_pos, str.substr(i));
+			break;
+		}
+		const auto exact = trie.follow(node_pos, str[i]);
+		const std::string_view rest = str.substr(i + 1);
+		const bool cont = trie.fan_out(node_pos, [&](auto child) {
+			return child == exact ||
+				approx_follow(trie, child, rest, budget - 1, fn);
+		});
+		if (!cont) {
+			return false;
+		}
+		node_pos = exact;
+	}
+	return node_pos ? fn(node_pos, budget) : true;
 }
 
 
 struct TriePoolStorage : TrieStorageBase<uint32_t, TriePoolStorage> {
-	TriePoolStorage() : nodes(1) {}
+	TriePoolStorage() : nodes(1), leaf_counts(1) {}
 
 	static constexpr value_type null() {
 		return value_type::from_raw(0u);
@@ -227,11 +383,27 @@ struct TriePoolStorage : TrieStorageBase<uint32_t, TriePoolStorage> {
 
 	value_type add_node() COLD {
 		nodes.emplace_back();
+		leaf_counts.push_back(0);
 		return value_type::from_raw(nodes.size() - 1);
 	}
 
 	void free_trie(value_type, size_t) COLD {}
 
+	void reserve(size_t count) COLD {
+		nodes.reserve(nodes.size() + count);
+		leaf_counts.reserve(leaf_counts.size() + count);
+	}
+
+	size_t memory_usage() const {
+		return nodes.capacity() * sizeof(node_type) +
+			leaf_counts.capacity() * sizeof leaf_counts[0];
+	}
+
+	/* Returns number of values below given inner node. */
+	size_t leaves(value_type node_pos) const {
+		return leaf_counts[node_pos.as_raw()];
+	}
+
 private:
 	static constexpr uint32_t encode_value(uint32_t v) { return v + 1; }
 	static constexpr uint32_t decode_value(uint32_t v) { return v - 1; }
@@ -243,7 +415,13 @@ private:
 		return nodes[data.as_raw()];
 	}
 
+	void count_leaf(value_type node_pos) COLD {
+		++leaf_counts[node_pos.as_raw()];
+	}
+
 	std::vector<node_type> nodes;
+	/* Number of values below each node, parallel to nodes. */
+	std::vector<uint32_t> leaf_counts;
 
 	friend class TrieStorageBase<uint32_t, TriePoolStorage>;
 	friend class TrieStorageBase<uint32_t, TriePoolStorage>::value_type;
@@ -258,6 +436,7 @@ struct TrieAllocStorage : TrieStorageBase<uintptr_t, TrieAllocStorage> {
 	}
 
 	value_type add_node() COLD {
+		++allocated;
 		return value_type::from_ptr(new node_type(null()));
 	}
 
@@ -281,6 +460,10 @@ struct TrieAllocStorage : TrieStorageBase<uintptr_t, TrieAllocStorage> {
 		}
 	}
 
+	size_t memory_usage() const {
+		return allocated * sizeof(node_type);
+	}
+
 private:
 	static constexpr uintptr_t encode_value(uintptr_t v) { return v; }
 	static constexpr uintptr_t decode_value(uintptr_t v) { return v; }
@@ -292,6 +475,8 @@ private:
 		return *data.as_ptr();
 	}
 
+	size_t allocated = 0;
+
 	friend class TrieStorageBase<uintptr_t, TrieAllocStorage>;
 	friend class TrieStorageBase<uintptr_t, TrieAllocStorage>::value_type;
 };
@@ -18,6 +18,7 @@
 #define H_VECTOR_MAP_H
 
 #include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <iterator>
 #include <map>
@@ -26,12 +27,20 @@
 #include <string_view>
 #include <vector>
 
+#include "query-stats.h"
+#include "result-sink.h"
+#include "util.h"
 #include "words.h"
 
 
-struct VectorMap {
-	VectorMap(const Words &words) : VectorMap(words.word_length(), words) {}
-	VectorMap(size_t length, const Words::Map &words)
+/* Sorted array of keys and their values.  N, if not zero, is the key
+   length known at compile time; VectorMap is the variant with run-time
+   length. */
+template <size_t N = 0>
+struct BasicVectorMap {
+	BasicVectorMap(const Words &words)
+		: BasicVectorMap(words.word_length(), words) {}
+	BasicVectorMap(size_t length, const Words::Map &words)
 		: count(words.size()), length(length),
 		  keys(new char[count * length]), values(new uint32_t[count]) {
 		auto kk = keys.get();
@@ -44,37 +53,62 @@ struct VectorMap {
 		}
 	}
 
-	template <class Fn>
-	void for_each_pair(std::string_view prefix, const Fn &fn) const {
-		auto [i, last] = range(prefix);
+	/* Calls fn(key, value) for each matching pair until fn returns
+	   false. */
+	template <class Fn, class Stats = NoStats>
+	void for_each_pair(std::string_view prefix, const Fn &fn,
+	                   Stats &&stats = {}) const {
+		auto [i, last] = range(prefix, stats);
 		for (; i < last; ++i) {
 			const std::string_view key(
 				keys.get() + i * length, length);
-			fn(key, values.get()[i]);
+			if (!fn(key, values.get()[i])) {
+				break;
+			}
 		}
 	}
 
-	template <class Fn>
-	size_t for_each_value(std::string_view prefix, const Fn &fn) const {
-		auto [first, last] = range(prefix);
-		const uint32_t *it = values.get() + first;
-		const uint32_t *const end = values.get() + last;
-		const size_t count = last - first;
-		for (; it < end; ++it ){
-			fn(*it);
-		}
+	/* Calls fn(value) for at most limit matching values and returns
+	   how many it was called for.  If fn is a sink, passes the values
+	   to it in a single run. */
+	template <class Fn, class Stats = NoStats>
+	size_t for_each_value(std::string_view prefix, Fn &&fn,
+	                      size_t limit = SIZE_MAX,
+	                      Stats &&stats = {}) const {
+		auto [first, last] = range(prefix, stats);
+		const size_t count = std::min(last - first, limit);
+		push_span(fn, values.get() + first, count);
 		return count;
 	}
 
-	std::pair<size_t, size_t> range(std::string_view prefix) const {
+	template <class Stats = NoStats>
+	std::pair<size_t, size_t> range(std::string_view prefix,
+	                                Stats &&stats = {}) const {
+		const WordsIter beg(keys.get(), length);
+		const auto [fst, lst] = std::equal_range(
+			beg, beg + count, Prefix(prefix), counting(stats));
+		return {fst - beg, lst - beg};
+	}
+
+	/* Narrows [lo, hi) range of keys sharing their first depth
+	   characters down to keys whose next character is ch.  Same as
+	   range() of the prefix extended by ch but bisects only the given
+	   range and compares a single character at a time. */
+	template <class Stats = NoStats>
+	std::pair<size_t, size_t> narrow(size_t lo, size_t hi,
+	                                 size_t depth, char ch,
+	                                 Stats &&stats = {}) const {
 		const WordsIter beg(keys.get(), length);
 		const auto [fst, lst] = std::equal_range(
-			beg, beg + count, Prefix(prefix));
+			beg + lo, beg + hi, Column{depth, ch}, counting(stats));
 		return {fst - beg, lst - beg};
 	}
 
 	size_t size() const { return count; }
-	size_t key_length() const { return length; }
+	constexpr size_t key_length() const { return length; }
+	size_t memory_usage() const {
+		return count * (length + sizeof(uint32_t));
+	}
 
 	const char *key(size_t idx) const {
 		return keys.get() + idx * key_length();
@@ -82,6 +116,10 @@ struct VectorMap {
 	uint32_t value(size_t idx) const {
 		return values[idx];
 	}
+	/* Returns pointer to values from given index on. */
+	const uint32_t *value_ptr(size_t idx) const {
+		return values.get() + idx;
+	}
 
 	struct Iterator : std::iterator<std::random_access_iterator_tag,
 	                                std::pair<std::string_view, uint32_t>> {
@@ -129,7 +167,7 @@ struct VectorMap {
 
 private:
 	const size_t count;
-	const size_t length;
+	[[no_unique_address]] const WordLength<N> length;
 	const std::unique_ptr<char[]> keys;
 	const std::unique_ptr<uint32_t[]> values;
 
@@ -149,15 +187,55 @@ private:
 		const std::string_view prefix;
 	};
 
-	friend bool operator<(VectorMap::Prefix prefix, std::string_view str) {
+	friend bool operator<(Prefix prefix, std::string_view str) {
 		return prefix.lt(str);
 	}
-	friend bool operator<(std::string_view str, VectorMap::Prefix prefix) {
+	friend bool operator<(std::string_view str, Prefix prefix) {
 		return prefix.gt(str);
 	}
 
-	VectorMap(const VectorMap&) = delete;
+	struct Column {
+		size_t depth;
+		char ch;
+	};
+
+	/* Returns comparator which counts comparisons in stats. */
+	template <class Stats>
+	static auto counting(Stats &stats) {
+		return [&stats](const auto &lhs, const auto &rhs) {
+			stats.compare();
+			return lhs < rhs;
+		};
+	}
+
+	friend bool operator<(Column col, std::string_view str) {
+		return col.ch < str[col.depth];
+	}
+	friend bool operator<(std::string_view str, Column col) {
+		return str[col.depth] < col.ch;
+	}
+
+	BasicVectorMap(const BasicVectorMap&) = delete;
 };
 
+using VectorMap = BasicVectorMap<>;
+
+
+/* Returns map from reversed keys of fwd to their index in fwd. */
+template <class Map>
+Map make_reversed(const Map &fwd) COLD;
+
+template <class Map>
+Map make_reversed(const Map &fwd) {
+	std::string word(fwd.key_length(), '\0');
+	Words::Map reversed;
+	for (size_t i = 0; i < fwd.size(); ++i) {
+		const char *const src = fwd.key(i);
+		std::reverse_copy(src, src + fwd.key_length(), word.data());
+		reversed.emplace(word, i);
+	}
+	return Map(fwd.key_length(), reversed);
+}
+
 
 #endif
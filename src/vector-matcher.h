@@ -18,6 +18,7 @@
 #define H_VECTOR_MATCHER_H
 
 #include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <exception>
 #include <iterator>
@@ -25,54 +26,127 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
+#include "front-coded-map.h"
+#include "query-stats.h"
 #include "util.h"
 #include "vector-map.h"
 #include "words.h"
 
 
-struct VectorMatcher {
+/* Map is BasicVectorMap<N> or, to trade speed for memory,
+   FrontCodedMap. */
+template <size_t N = 0, class Map = BasicVectorMap<N>>
+struct BasicVectorMatcher {
 	using Query = std::pair<std::string_view, std::string_view>;
 
-	VectorMatcher(const Words &words) : words(words) {};
+	BasicVectorMatcher(const Words &words) : words(words) {};
 
 	size_t size() const { return words.size(); }
 	size_t word_length() const { return words.key_length(); }
-	template <class Callback>
+	size_t memory_usage() const {
+		return sizeof *this + words.memory_usage();
+	}
+	template <class Callback, class Stats = NoStats>
 	inline size_t query(std::string_view prefix,
 	                    std::string_view suffix,
-	                    Callback &cb) const HOT;
+	                    Callback &cb,
+	                    size_t limit = SIZE_MAX,
+	                    Stats &&stats = {}) const HOT;
+
+	/* Typeahead cursor.  Remembers range of words matching the prefix
+	   typed so far and narrows it as the prefix is extended. */
+	struct Cursor {
+		explicit Cursor(const BasicVectorMatcher &matcher)
+			: words(matcher.words), hi(words.size()) {}
+
+		void extend_prefix(char ch) HOT {
+			if (depth < words.key_length()) {
+				std::tie(lo, hi) = words.narrow(lo, hi, depth, ch);
+			}
+			++depth;
+		}
+		void set_suffix(std::string_view sfx) { suffix.assign(sfx); }
+
+		template <class Callback>
+		size_t query(Callback &cb, size_t limit = SIZE_MAX) const HOT;
+
+	private:
+		const Map &words;
+		size_t lo = 0, hi, depth = 0;
+		std::string suffix;
+	};
+
+	Cursor cursor() const { return Cursor(*this); }
 
 private:
-	VectorMap words;
+	Map words;
 
-	VectorMatcher() = delete;
-	VectorMatcher(const VectorMatcher&) = delete;
+	BasicVectorMatcher() = delete;
+	BasicVectorMatcher(const BasicVectorMatcher&) = delete;
 };
 
+using VectorMatcher = BasicVectorMatcher<>;
+using FrontCodedVectorMatcher = BasicVectorMatcher<0, FrontCodedMap<>>;
 
-template <class Callback>
-size_t VectorMatcher::query(std::string_view prefix,
-                            std::string_view suffix,
-                            Callback &cb) const {
+
+template <size_t N, class Map>
+template <class Callback, class Stats>
+size_t BasicVectorMatcher<N, Map>::query(std::string_view prefix,
+                                         std::string_view suffix,
+                                         Callback &cb, size_t limit,
+                                         Stats &&stats) const {
 	if (prefix.size() + suffix.size() == word_length() || suffix.empty()) {
-		return words.for_each_value(std::string(prefix) += suffix, cb);
+		const size_t cnt = words.for_each_value(
+			std::string(prefix) += suffix, cb, limit, stats);
+		stats.emit(cnt);
+		return cnt;
+	}
+	if (!limit) {
+		return 0;
 	}
 
 	const size_t offset = word_length() - suffix.size();
 	size_t cnt = 0;
 	words.for_each_pair(
 		prefix,
-		[&cb, &cnt, suffix, offset](std::string_view key, uint32_t v) {
+		[&cb, &cnt, &stats, suffix, offset, limit](std::string_view key,
+		                                           uint32_t v) {
 			key = std::string_view(
 				key.data() + offset, suffix.size());
+			stats.compare();
 			if (key == suffix) {
 				cb(v);
-				++cnt;
+				return ++cnt < limit;
 			}
-		});
+			stats.filter();
+			return true;
+		}, stats);
 
+	stats.emit(cnt);
+	return cnt;
+}
+
+
+template <size_t N, class Map>
+template <class Callback>
+size_t BasicVectorMatcher<N, Map>::Cursor::query(Callback &cb,
+                                                 size_t limit) const {
+	const size_t length = words.key_length();
+	if (depth + suffix.size() > length) {
+		return 0;
+	}
+	const size_t offset = length - suffix.size();
+	size_t cnt = 0;
+	for (size_t i = lo; i < hi && cnt < limit; ++i) {
+		if (!std::memcmp(words.key(i) + offset,
+		                 suffix.data(), suffix.size())) {
+			cb(words.value(i));
+			++cnt;
+		}
+	}
 	return cnt;
 }
 
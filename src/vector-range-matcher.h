@@ -17,70 +17,225 @@
 #ifndef H_VECTOR_RANGE_MATCHER_H
 #define H_VECTOR_RANGE_MATCHER_H
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
+#include "front-coded-map.h"
+#include "query-stats.h"
+#include "result-sink.h"
 #include "util.h"
 #include "vector-map.h"
 #include "words.h"
 
 
-struct VectorRangeMatcher {
-	VectorRangeMatcher(const Words &words)
-		: fwd(words), rev(make_rev(fwd)) {}
+/* Map is VectorMap or, to trade speed for memory, FrontCodedMap. */
+template <class Map = VectorMap>
+struct BasicVectorRangeMatcher {
+	BasicVectorRangeMatcher(const Words &words)
+		: fwd(words), rev(make_reversed(fwd)) {}
 
 
 	size_t size() const { return fwd.size(); }
 	size_t word_length() const { return fwd.key_length(); }
-	template <class Callback>
+	size_t memory_usage() const {
+		return sizeof *this + fwd.memory_usage() + rev.memory_usage();
+	}
+	template <class Callback, class Stats = NoStats>
 	inline size_t query(std::string_view prefix,
 	                    std::string_view suffix,
-	                    Callback &cb) const HOT;
+	                    Callback &cb,
+	                    size_t limit = SIZE_MAX,
+	                    Stats &&stats = {}) const HOT;
+
+	/* Reports words of chunk-th of chunks equal parts of the range query
+	   walks, so chunks can run concurrently and concatenated in order
+	   give the same result as query. */
+	template <class Callback, class Stats = NoStats>
+	size_t query_chunk(std::string_view prefix, std::string_view suffix,
+	                   size_t chunk, size_t chunks,
+	                   Callback &cb, size_t limit = SIZE_MAX,
+	                   Stats &&stats = {}) const HOT;
+
+	/* Returns number of entries query walks, an upper bound of what it
+	   reports. */
+	size_t estimate(std::string_view prefix,
+	                std::string_view suffix) const {
+		NoStats stats;
+		const Walk w = plan(prefix, suffix, stats);
+		return w.last - w.first;
+	}
 
-private:
-	static VectorMap make_rev(const VectorMap &fwd) {
-		std::string word(fwd.key_length(), '\0');
-		Words::Map reversed;
-		for (const auto &pair : fwd) {
-			std::string_view src = pair.first;
-			std::copy(src.rbegin(), src.rend(), word.data());
-			reversed.emplace(word, pair.second);
+	/* Typeahead cursor.  Remembers range of words matching the prefix
+	   typed so far, narrowing it as the prefix is extended, and range of
+	   reversed words matching the suffix. */
+	struct Cursor {
+		explicit Cursor(const BasicVectorRangeMatcher &matcher)
+			: fwd(matcher.fwd), rev(matcher.rev),
+			  hi(fwd.size()), rhi(rev.size()) {}
+
+		void extend_prefix(char ch) HOT {
+			if (depth < fwd.key_length()) {
+				std::tie(lo, hi) = fwd.narrow(lo, hi, depth, ch);
+			}
+			++depth;
+		}
+		void set_suffix(std::string_view sfx) {
+			suffix.assign(sfx);
+			if (suffix.size() <= rev.key_length()) {
+				const std::string reversed(sfx.rbegin(),
+				                           sfx.rend());
+				std::tie(rlo, rhi) = rev.range(reversed);
+			}
 		}
-		return VectorMap(fwd.key_length(), reversed);
-	}
 
-	VectorMap fwd, rev;
+		template <class Callback>
+		size_t query(Callback &cb, size_t limit = SIZE_MAX) const HOT;
+
+	private:
+		const Map &fwd, &rev;
+		size_t lo = 0, hi, rlo = 0, rhi, depth = 0;
+		std::string suffix;
+	};
+
+	Cursor cursor() const { return Cursor(*this); }
+
+private:
+	/* Entries a query walks: [first, last) of fwd or, if reversed, of
+	   rev keeping only those which point into [lo, hi) of fwd. */
+	struct Walk {
+		size_t first, last, lo, hi;
+		bool reversed;
+	};
 
-	VectorRangeMatcher() = delete;
-	VectorRangeMatcher(const VectorRangeMatcher&) = delete;
+	template <class Stats>
+	Walk plan(std::string_view prefix, std::string_view suffix,
+	          Stats &stats) const HOT;
+
+	template <class Callback, class Stats>
+	size_t walk(const Walk &w, size_t first, size_t last,
+	            Callback &cb, size_t limit, Stats &stats) const HOT;
+
+	Map fwd, rev;
+
+	BasicVectorRangeMatcher() = delete;
+	BasicVectorRangeMatcher(const BasicVectorRangeMatcher&) = delete;
 };
 
-template <class Callback>
-size_t VectorRangeMatcher::query(std::string_view prefix,
-                                 std::string_view suffix,
-                                 Callback &cb) const {
+using VectorRangeMatcher = BasicVectorRangeMatcher<>;
+using FrontCodedVectorRangeMatcher = BasicVectorRangeMatcher<FrontCodedMap<>>;
+
+
+template <class Map>
+template <class Callback, class Stats>
+size_t BasicVectorRangeMatcher<Map>::query(std::string_view prefix,
+                                           std::string_view suffix,
+                                           Callback &cb, size_t limit,
+                                           Stats &&stats) const {
+	const Walk w = plan(prefix, suffix, stats);
+	return walk(w, w.first, w.last, cb, limit, stats);
+}
+
+
+template <class Map>
+template <class Callback, class Stats>
+size_t BasicVectorRangeMatcher<Map>::query_chunk(std::string_view prefix,
+                                                 std::string_view suffix,
+                                                 size_t chunk, size_t chunks,
+                                                 Callback &cb, size_t limit,
+                                                 Stats &&stats) const {
+	const Walk w = plan(prefix, suffix, stats);
+	const size_t n = w.last - w.first;
+	return walk(w, w.first + n * chunk / chunks,
+	            w.first + n * (chunk + 1) / chunks, cb, limit, stats);
+}
+
+
+template <class Map>
+template <class Stats>
+typename BasicVectorRangeMatcher<Map>::Walk
+BasicVectorRangeMatcher<Map>::plan(std::string_view prefix,
+                                   std::string_view suffix,
+                                   Stats &stats) const {
 	if (prefix.size() + suffix.size() == word_length() ||
 	    prefix.empty() || suffix.empty()) {
 		const bool isSuffix = prefix.empty() &&
 			suffix.size() != word_length();
 		std::string ix = std::string(prefix) += suffix;
-		if (isSuffix) {
-			std::reverse(ix.begin(), ix.end());
+		if (!isSuffix) {
+			const auto [first, last] = fwd.range(ix, stats);
+			return {first, last, 0, 0, false};
 		}
-		return (isSuffix ? rev : fwd).for_each_value(ix, cb);
+		std::reverse(ix.begin(), ix.end());
+		const auto [first, last] = rev.range(ix, stats);
+		return {first, last, 0, fwd.size(), true};
+	}
+
+	const auto [lo, hi] = fwd.range(prefix, stats);
+	const std::string suffix_str(suffix.rbegin(), suffix.rend());
+	const auto [first, last] = rev.range(suffix_str, stats);
+	return {first, last, lo, hi, true};
+}
+
+
+template <class Map>
+template <class Callback, class Stats>
+size_t BasicVectorRangeMatcher<Map>::walk(const Walk &w,
+                                          size_t first, size_t last,
+                                          Callback &cb, size_t limit,
+                                          Stats &stats) const {
+	size_t cnt;
+	if (!w.reversed) {
+		cnt = std::min(last - first, limit);
+		push_span(cb, fwd.value_ptr(first), cnt);
+	} else {
+		const auto in_prefix = [lo = w.lo, hi = w.hi](uint32_t v) {
+			return lo <= v && v < hi;
+		};
+		const auto to_id = [this](uint32_t v) { return fwd.value(v); };
+		const uint32_t *it = rev.value_ptr(first);
+		cnt = push_if(cb, it, rev.value_ptr(last), limit,
+		              in_prefix, to_id);
+		stats.filter(it - rev.value_ptr(first) - cnt);
 	}
+	stats.emit(cnt);
+	return cnt;
+}
+
 
-	const auto [lo, hi] = fwd.range(prefix);
-	std::string suffix_str(suffix.rbegin(), suffix.rend());
+/* Scans whichever of the prefix and suffix ranges is smaller. */
+template <class Map>
+template <class Callback>
+size_t BasicVectorRangeMatcher<Map>::Cursor::query(Callback &cb,
+                                                   size_t limit) const {
+	const size_t length = fwd.key_length();
+	if (depth + suffix.size() > length) {
+		return 0;
+	}
 	size_t cnt = 0;
-	rev.for_each_value(suffix_str, [&cnt, &cb, lo, hi, this](uint32_t v) {
-		if (lo <= v && v < hi) {
-			cb(fwd.value(v));
-			++cnt;
+	if (hi - lo <= rhi - rlo) {
+		const size_t offset = length - suffix.size();
+		for (size_t i = lo; i < hi && cnt < limit; ++i) {
+			if (!std::memcmp(fwd.key(i) + offset,
+			                 suffix.data(), suffix.size())) {
+				cb(fwd.value(i));
+				++cnt;
+			}
 		}
-	});
+	} else {
+		for (size_t i = rlo; i < rhi && cnt < limit; ++i) {
+			const uint32_t v = rev.value(i);
+			if (lo <= v && v < hi) {
+				cb(fwd.value(v));
+				++cnt;
+			}
+		}
+	}
 	return cnt;
 }
 
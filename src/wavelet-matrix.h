@@ -0,0 +1,115 @@
+/* Pattern Matching problem benchmark
+   Copyright © 2021 Michał Nazarewicz <mina86@mina86.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifndef H_WAVELET_MATRIX_H
+#define H_WAVELET_MATRIX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bit-vector.h"
+#include "util.h"
+
+
+/* Sequence of symbols smaller than 2^Bits supporting access and rank.
+   Level l holds bit l (counting from the most significant) of every
+   symbol, with the symbols stably sorted by their higher bits: those
+   with the bit clear first, then those with it set.  Following a
+   position down the levels costs one bit vector rank per level. */
+template <unsigned Bits>
+struct WaveletMatrix {
+	explicit WaveletMatrix(std::vector<uint8_t> symbols) COLD;
+
+	size_t size() const { return count; }
+
+	/* Returns number of occurrences of sym before pos. */
+	size_t rank(uint8_t sym, size_t pos) const HOT {
+		for (unsigned l = 0; l < Bits; ++l) {
+			pos = down(l, sym >> (Bits - 1 - l) & 1, pos);
+		}
+		return pos - starts[sym];
+	}
+
+	/* Returns symbol at pos and number of its occurrences before
+	   pos. */
+	std::pair<uint8_t, size_t> access_rank(size_t pos) const HOT {
+		uint8_t sym = 0;
+		for (unsigned l = 0; l < Bits; ++l) {
+			const bool bit = levels[l][pos];
+			sym = sym << 1 | bit;
+			pos = down(l, bit, pos);
+		}
+		return { sym, pos - starts[sym] };
+	}
+
+	size_t memory_usage() const {
+		size_t ret = 0;
+		for (const BitVector &level : levels) {
+			ret += level.memory_usage();
+		}
+		return ret;
+	}
+
+private:
+	/* Maps pos on level l to the next level given bit of the symbol. */
+	size_t down(unsigned l, bool bit, size_t pos) const HOT {
+		return bit ? zeros[l] + levels[l].rank1(pos)
+		           : levels[l].rank0(pos);
+	}
+
+	BitVector levels[Bits];
+	size_t zeros[Bits];
+	/* Position past the last level where each symbol's run starts. */
+	size_t starts[1 << Bits];
+	size_t count;
+};
+
+
+template <unsigned Bits>
+WaveletMatrix<Bits>::WaveletMatrix(std::vector<uint8_t> symbols)
+	: count(symbols.size()) {
+	std::vector<uint8_t> ones;
+	for (unsigned l = 0; l < Bits; ++l) {
+		const unsigned shift = Bits - 1 - l;
+		ones.clear();
+		size_t n = 0;
+		for (const uint8_t sym : symbols) {
+			const bool bit = sym >> shift & 1;
+			levels[l].push_back(bit);
+			if (bit) {
+				ones.push_back(sym);
+			} else {
+				symbols[n++] = sym;
+			}
+		}
+		zeros[l] = n;
+		std::copy(ones.begin(), ones.end(), symbols.begin() + n);
+		levels[l].build();
+	}
+
+	for (unsigned sym = 0; sym < (1 << Bits); ++sym) {
+		size_t pos = 0;
+		for (unsigned l = 0; l < Bits; ++l) {
+			pos = down(l, sym >> (Bits - 1 - l) & 1, pos);
+		}
+		starts[sym] = pos;
+	}
+}
+
+
+#endif
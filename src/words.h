@@ -18,6 +18,8 @@
 #define H_WORDS_H
 
 #include <iterator>
+#include <map>
+#include <string>
 #include <string_view>
 
 
@@ -81,6 +83,26 @@ private:
 };
 
 
+/* Length of words handled by a matcher.  With N == 0 the length is known
+   only at run time and is stored; otherwise it is the constant N, which
+   lets the compiler unroll loops over words.  Either way it converts to
+   size_t so code using it doesn't need to care. */
+template <size_t N>
+struct WordLength {
+	constexpr WordLength(size_t) {}
+	constexpr operator size_t() const { return N; }
+};
+
+template <>
+struct WordLength<0> {
+	constexpr WordLength(size_t length) : length(length) {}
+	constexpr operator size_t() const { return length; }
+
+private:
+	size_t length;
+};
+
+
 struct Words {
 	using Map = std::map<std::string, size_t>;
 
@@ -98,6 +120,13 @@ struct Words {
 		return {reversed, length};
 	}
 
+	/* Returns words whose first letter is within [first, last]. */
+	Words subset(char first, char last) const {
+		const auto begin = words.lower_bound(std::string(1, first));
+		const auto end = words.lower_bound(std::string(1, last + 1));
+		return {Map(begin, end), length};
+	}
+
 	bool empty() const { return words.empty(); }
 	size_t size() const { return words.size(); }
 	size_t word_length() const { return length; }